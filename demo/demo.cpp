@@ -20,7 +20,6 @@ along with this program.  If not, see <https://www.gnu.org/licenses/>.
 #include <peel/GLib/MainContext.h>
 #include <peel/GLib/DateTime.h>
 #include <peel/GLib/Error.h>
-#include <peel/ArrayRef.h>
 #include "youtube_types.hpp"
 #include "youtube_chat_client.hpp"
 #include <memory>
@@ -85,9 +84,12 @@ int main(int argc, char** argv)
         auto expiration_str = expiration->format_iso8601();
         g_message("Access token expiration: %s", expiration_str.c_str());
     });
-    client->connect_new_messages([](youtube::ChatClient*, const char*, void* data) {
-        auto& messages = *static_cast<peel::ArrayRef<const youtube::ChatMessage>*>(data);
-        for(const auto& msg : messages) {
+    client->connect_new_messages([](youtube::ChatClient*, const char*, youtube::MessageBatch* batch) {
+        for(const auto& msg : *batch) {
+            if(msg.type == youtube::ChatMessage::Type::Deleted) {
+                g_print("(Message %s was deleted)\n\n", msg.target_id.c_str());
+                continue;
+            }
             auto local_timestamp = msg.timestamp->to_local();
             auto timestamp_str = local_timestamp->format("%I:%M:%S %p");
             g_print("%s (%s): %s\n\n", msg.display_name.c_str(), timestamp_str.c_str(), msg.content.c_str());
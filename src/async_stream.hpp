@@ -0,0 +1,197 @@
+/*
+BirdTube - YouTube live chat protocol plugin
+Copyright (C) 2026 Cole Blakley
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+#pragma once
+
+#include <coroutine>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <utility>
+#include <glib.h>
+#include "main_context.hpp"
+
+/* Bounded queue of values that a consumer coroutine pulls from one at a time:
+
+       while(auto value = co_await stream.next()) { ... }
+
+   Copies of an AsyncStream refer to the same queue, so the producer and consumer each hold one.
+   The producer and consumer may run on different threads; the consumer is always resumed on the
+   main context it was running on when it called next(). The bound is not enforced by push();
+   instead, the producer is expected to check wait_for_room() and hold off producing more until the
+   consumer has caught up. A bound of 0 means unbounded */
+template<typename T>
+class AsyncStream {
+    struct State;
+public:
+    class Next {
+    public:
+        constexpr bool await_ready() const noexcept { return false; }
+
+        bool await_suspend(std::coroutine_handle<> handle)
+        {
+            std::lock_guard lock{state->mutex};
+            if(!state->buffer.empty() || state->is_closed) {
+                return false;
+            }
+            state->waiter = handle;
+            state->waiter_context = g_main_context_ref_thread_default();
+            return true;
+        }
+
+        // Returns nothing once the stream has been closed and all buffered values have been taken
+        std::optional<T> await_resume()
+        {
+            std::unique_lock lock{state->mutex};
+            if(state->buffer.empty()) {
+                return {};
+            }
+            std::optional<T> value{std::move(state->buffer.front())};
+            state->buffer.pop_front();
+            if(state->buffer.size() < state->max_buffered) {
+                state->notify_producer(lock);
+            }
+            return value;
+        }
+    private:
+        friend class AsyncStream;
+        explicit
+        Next(std::shared_ptr<State> state)
+            : state(std::move(state)) {}
+
+        std::shared_ptr<State> state;
+    };
+
+    explicit
+    AsyncStream(std::size_t max_buffered)
+        : state(std::make_shared<State>(max_buffered)) {}
+
+    // Consumer side
+    Next next() { return Next{state}; }
+
+    // Either side. Values that are already buffered can still be taken by next()
+    void close()
+    {
+        std::unique_lock lock{state->mutex};
+        if(state->is_closed) {
+            return;
+        }
+        state->is_closed = true;
+        state->resume_waiter(lock);
+        // A paused producer has nothing left to wait for
+        lock.lock();
+        state->notify_producer(lock);
+    }
+
+    bool is_closed() const
+    {
+        std::lock_guard lock{state->mutex};
+        return state->is_closed;
+    }
+
+    // Producer side. Ignores the value if the stream is closed
+    void push(T value)
+    {
+        std::unique_lock lock{state->mutex};
+        if(state->is_closed) {
+            return;
+        }
+        state->buffer.push_back(std::move(value));
+        state->resume_waiter(lock);
+    }
+
+    // Producer side. Returns true if the consumer has room for another value. Otherwise returns
+    // false, and on_room is later called on the calling thread's main context once the consumer has
+    // taken enough values to make room (or the stream is closed). on_room is only moved from if
+    // this returns false
+    template<typename F>
+    bool wait_for_room(F&& on_room)
+    {
+        std::lock_guard lock{state->mutex};
+        if(state->is_closed || state->buffer.size() < state->max_buffered) {
+            return true;
+        }
+        state->on_room = std::forward<F>(on_room);
+        if(state->producer_context) {
+            g_main_context_unref(state->producer_context);
+        }
+        state->producer_context = g_main_context_ref_thread_default();
+        return false;
+    }
+
+    std::size_t get_buffered_count() const
+    {
+        std::lock_guard lock{state->mutex};
+        return state->buffer.size();
+    }
+private:
+    struct State {
+        explicit
+        State(std::size_t max_buffered)
+            : max_buffered(max_buffered ? max_buffered : SIZE_MAX) {}
+        ~State() noexcept
+        {
+            if(waiter_context) {
+                g_main_context_unref(waiter_context);
+            }
+            if(producer_context) {
+                g_main_context_unref(producer_context);
+            }
+        }
+
+        // Both of these unlock the mutex
+        void resume_waiter(std::unique_lock<std::mutex>& lock)
+        {
+            auto handle = std::exchange(waiter, nullptr);
+            GMainContext* context = std::exchange(waiter_context, nullptr);
+            lock.unlock();
+            if(handle) {
+                // Deferred so that the consumer never runs inside of push()/close()
+                post_to(context, [handle] { handle.resume(); });
+                g_main_context_unref(context);
+            }
+        }
+
+        void notify_producer(std::unique_lock<std::mutex>& lock)
+        {
+            auto callback = std::exchange(on_room, nullptr);
+            GMainContext* context = std::exchange(producer_context, nullptr);
+            lock.unlock();
+            if(callback) {
+                post_to(context, std::move(callback));
+                g_main_context_unref(context);
+            }
+        }
+
+        mutable std::mutex mutex;
+        std::deque<T> buffer;
+        std::size_t max_buffered;
+        bool is_closed = false;
+        // Consumer currently suspended in next()
+        std::coroutine_handle<> waiter;
+        GMainContext* waiter_context = nullptr;
+        // Set while the producer is paused waiting for room
+        std::move_only_function<void()> on_room;
+        GMainContext* producer_context = nullptr;
+    };
+
+    std::shared_ptr<State> state;
+};
@@ -0,0 +1,340 @@
+/*
+BirdTube - YouTube live chat protocol plugin
+Copyright (C) 2026 Cole Blakley
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+#include "client_context.hpp"
+#include <gio/gio.h>
+#include <libsoup/soup.h>
+#include <peel/Soup/Message.h>
+#include <algorithm>
+#include <utility>
+#include <vector>
+#ifdef YOUTUBE_CHAT_CLIENT_LOGGING
+#include <peel/Soup/Logger.h>
+#include <peel/Soup/LoggerLogLevel.h>
+#endif
+#include "main_context.hpp"
+
+namespace youtube {
+
+#define MAX_CONNECTIONS 32
+#define MAX_CONNECTIONS_PER_HOST 6
+// Seconds an idle connection is kept open by the session before being closed
+#define IDLE_CONNECTION_TIMEOUT 60
+// Idle connections are kept open for a while, so there's no point preconnecting more often
+#define PRECONNECT_INTERVAL (30 * G_USEC_PER_SEC)
+// Kept-warm connections that have had no requests for this many microseconds get a keep-alive
+// request, which needs to arrive before the session's idle timeout closes them
+#define KEEPALIVE_IDLE_TIME (40 * G_USEC_PER_SEC)
+#define KEEPALIVE_CHECK_INTERVAL 10
+// Refreshes due within this many microseconds of the earliest one are done in the same batch
+#define REFRESH_COALESCE_WINDOW (60 * G_USEC_PER_SEC)
+#define REFRESH_BATCH_SIZE 4
+// Milliseconds between batches when more refreshes are due than fit in one batch
+#define REFRESH_BATCH_INTERVAL 5000
+// Seconds between checks for system suspend/clock changes
+#define CLOCK_CHECK_INTERVAL 5
+// Microseconds the real and monotonic clocks can drift apart between checks before it counts as a jump
+#define CLOCK_JUMP_THRESHOLD (15 * G_USEC_PER_SEC)
+// Milliseconds between each client's catch-up after connectivity returns
+#define RESYNC_STAGGER 750
+
+ClientContext& ClientContext::get_default()
+{
+    // Never destroyed, since clients may still be finishing up during exit
+    static ClientContext* client_context = new ClientContext;
+    return *client_context;
+}
+
+ClientContext::ClientContext()
+    : session(gobject::Object::create<soup::Session>(
+          soup::Session::prop_max_conns(), (int)MAX_CONNECTIONS,
+          soup::Session::prop_max_conns_per_host(), (int)MAX_CONNECTIONS_PER_HOST,
+          soup::Session::prop_idle_timeout(), (unsigned)IDLE_CONNECTION_TIMEOUT))
+{
+    #ifdef YOUTUBE_CHAT_CLIENT_LOGGING
+    auto logger = soup::Logger::create(soup::Logger::LogLevel::BODY);
+    session->add_feature(logger);
+    #endif
+
+    GNetworkMonitor* monitor = g_network_monitor_get_default();
+    this->network_available = g_network_monitor_get_network_available(monitor);
+    g_signal_connect(monitor, "network-changed", G_CALLBACK(+[](GNetworkMonitor*, gboolean available, gpointer data) {
+        auto* self = static_cast<ClientContext*>(data);
+        if(self->network_available.exchange(available) != (bool)available) {
+            g_message("Network is now %s", available ? "available" : "unavailable");
+            self->notify_connectivity(available);
+        }
+    }), this);
+
+    this->last_real_time = g_get_real_time();
+    this->last_monotonic_time = g_get_monotonic_time();
+    g_timeout_add_seconds(CLOCK_CHECK_INTERVAL, [](gpointer data) -> gboolean {
+        static_cast<ClientContext*>(data)->check_for_clock_jump();
+        return G_SOURCE_CONTINUE;
+    }, this);
+}
+
+void ClientContext::add_connectivity_listener(const void* owner, GMainContext* context, ConnectivityCallback callback)
+{
+    auto listener = std::make_shared<ConnectivityListener>();
+    listener->callback = std::move(callback);
+    std::lock_guard lock{this->connectivity_mutex};
+    this->connectivity_listeners.insert_or_assign(
+        owner, std::make_pair(g_main_context_ref(context), std::move(listener)));
+}
+
+void ClientContext::remove_connectivity_listener(const void* owner)
+{
+    std::lock_guard lock{this->connectivity_mutex};
+    auto match = this->connectivity_listeners.find(owner);
+    if(match == this->connectivity_listeners.end()) {
+        return;
+    }
+    auto& [context, listener] = match->second;
+    listener->is_removed = true;
+    g_main_context_unref(context);
+    this->connectivity_listeners.erase(match);
+}
+
+void ClientContext::notify_connectivity(bool is_available)
+{
+    std::lock_guard lock{this->connectivity_mutex};
+    guint resync_delay = 0;
+    for(auto& [_, entry] : this->connectivity_listeners) {
+        auto& [context, listener] = entry;
+        invoke_on(context, [listener, is_available, resync_delay] {
+            if(!listener->is_removed) {
+                listener->callback(is_available, resync_delay);
+            }
+        });
+        if(is_available) {
+            resync_delay += RESYNC_STAGGER;
+        }
+    }
+}
+
+void ClientContext::check_for_clock_jump()
+{
+    gint64 real_time = g_get_real_time();
+    gint64 monotonic_time = g_get_monotonic_time();
+    gint64 drift = (real_time - this->last_real_time) - (monotonic_time - this->last_monotonic_time);
+    this->last_real_time = real_time;
+    this->last_monotonic_time = monotonic_time;
+    if(drift < CLOCK_JUMP_THRESHOLD && drift > -CLOCK_JUMP_THRESHOLD) {
+        return;
+    }
+    // The monotonic clock doesn't advance while suspended, so this is usually a wakeup. Whatever was
+    // in flight is probably dead, and every timer is overdue at once
+    g_message("Detected suspend or clock change (%" G_GINT64_FORMAT " s)", drift / G_USEC_PER_SEC);
+    {
+        // Refresh times are in real time, so the timer's delay needs to be worked out again
+        std::lock_guard lock{this->refresh_mutex};
+        if(!this->refreshes.empty()) {
+            gint64 delay = std::max<gint64>(
+                this->refreshes.begin()->first - REFRESH_COALESCE_WINDOW - real_time, 0);
+            arm_refresh_timer((guint)(delay / 1000));
+        }
+    }
+    notify_connectivity(false);
+    if(is_network_available()) {
+        notify_connectivity(true);
+    }
+}
+
+void ClientContext::preconnect(const char* uri)
+{
+    gint64 now = g_get_monotonic_time();
+    {
+        std::lock_guard lock{this->warm_mutex};
+        gint64& last = this->last_preconnects[uri];
+        if(last != 0 && now - last < PRECONNECT_INTERVAL) {
+            return;
+        }
+        last = now;
+    }
+    auto message = soup::Message::create("HEAD", uri);
+    if(!message) {
+        return;
+    }
+    this->preconnect_count.fetch_add(1, std::memory_order_relaxed);
+    // Nothing to do on completion: a failure here will just show up again on the first real request
+    soup_session_preconnect_async(
+        reinterpret_cast<SoupSession*>(static_cast<soup::Session*>(this->session)),
+        reinterpret_cast<SoupMessage*>(static_cast<soup::Message*>(message)), G_PRIORITY_LOW, nullptr,
+        [](GObject* session, GAsyncResult* result, gpointer) {
+            soup_session_preconnect_finish(SOUP_SESSION(session), result, nullptr);
+        }, nullptr);
+}
+
+ClientContext::KeepWarm ClientContext::keep_warm(const char* uri)
+{
+    preconnect(uri);
+    std::lock_guard lock{this->warm_mutex};
+    ++this->warm_uris[uri];
+    if(!this->keepalive_source) {
+        this->keepalive_source = g_timeout_add_seconds(KEEPALIVE_CHECK_INTERVAL, [](gpointer data) -> gboolean {
+            static_cast<ClientContext*>(data)->send_keepalives();
+            return G_SOURCE_CONTINUE;
+        }, this);
+    }
+    return KeepWarm{uri};
+}
+
+void ClientContext::KeepWarm::release() noexcept
+{
+    if(!this->uri.empty()) {
+        ClientContext::get_default().release_warm(this->uri);
+        this->uri.clear();
+    }
+}
+
+void ClientContext::release_warm(const std::string& uri)
+{
+    std::lock_guard lock{this->warm_mutex};
+    auto match = this->warm_uris.find(uri);
+    if(match == this->warm_uris.end() || --match->second != 0) {
+        return;
+    }
+    this->warm_uris.erase(match);
+    if(this->warm_uris.empty() && this->keepalive_source) {
+        // Note: the source is always on the global default context, so this is safe from any thread
+        g_source_remove(this->keepalive_source);
+        this->keepalive_source = 0;
+    }
+}
+
+void ClientContext::send_keepalives()
+{
+    gint64 now = g_get_monotonic_time();
+    if(now - this->last_activity.load(std::memory_order_relaxed) < KEEPALIVE_IDLE_TIME) {
+        // Regular requests are already keeping the connections open
+        return;
+    }
+    note_activity();
+    std::vector<std::string> uris;
+    {
+        std::lock_guard lock{this->warm_mutex};
+        for(auto& [uri, _] : this->warm_uris) {
+            uris.push_back(uri);
+        }
+    }
+    for(auto& uri : uris) {
+        auto message = soup::Message::create("HEAD", uri.c_str());
+        if(!message) {
+            continue;
+        }
+        this->keepalive_count.fetch_add(1, std::memory_order_relaxed);
+        // Only sent to reuse (and so reset the idle timeout of) the connection; the response
+        // itself doesn't matter
+        soup_session_send_and_read_async(
+            reinterpret_cast<SoupSession*>(static_cast<soup::Session*>(this->session)),
+            reinterpret_cast<SoupMessage*>(static_cast<soup::Message*>(message)), G_PRIORITY_LOW, nullptr,
+            [](GObject* session, GAsyncResult* result, gpointer) {
+                if(GBytes* body = soup_session_send_and_read_finish(SOUP_SESSION(session), result, nullptr)) {
+                    g_bytes_unref(body);
+                }
+            }, nullptr);
+    }
+}
+
+ConnectionWarmupStats ClientContext::get_warmup_stats() const
+{
+    return ConnectionWarmupStats{
+        .preconnects = this->preconnect_count.load(std::memory_order_relaxed),
+        .keepalives = this->keepalive_count.load(std::memory_order_relaxed),
+    };
+}
+
+void ClientContext::schedule_refresh(const void* owner, gint64 due_time, GMainContext* context,
+                                     std::move_only_function<void()> refresh)
+{
+    cancel_refresh(owner);
+    std::lock_guard lock{this->refresh_mutex};
+    auto entry = this->refreshes.emplace(
+        due_time, ScheduledRefresh{owner, g_main_context_ref(context), std::move(refresh)});
+    this->refresh_owners.emplace(owner, entry);
+    if(entry == this->refreshes.begin()) {
+        // New earliest refresh
+        gint64 delay = std::max<gint64>(due_time - REFRESH_COALESCE_WINDOW - g_get_real_time(), 0);
+        arm_refresh_timer((guint)(delay / 1000));
+    }
+}
+
+void ClientContext::cancel_refresh(const void* owner)
+{
+    std::lock_guard lock{this->refresh_mutex};
+    auto match = this->refresh_owners.find(owner);
+    if(match == this->refresh_owners.end()) {
+        return;
+    }
+    g_main_context_unref(match->second->second.context);
+    this->refreshes.erase(match->second);
+    this->refresh_owners.erase(match);
+    // The timer is left as-is; if it fires early, it just finds nothing to do yet
+}
+
+// Call with refresh_mutex held
+void ClientContext::arm_refresh_timer(guint delay)
+{
+    if(this->refresh_timer) {
+        g_source_destroy(this->refresh_timer);
+        g_source_unref(this->refresh_timer);
+    }
+    this->refresh_timer = g_timeout_source_new(delay);
+    g_source_set_callback(this->refresh_timer, [](gpointer data) -> gboolean {
+        static_cast<ClientContext*>(data)->run_due_refreshes();
+        return G_SOURCE_REMOVE;
+    }, this, nullptr);
+    g_source_attach(this->refresh_timer, g_main_context_default());
+}
+
+void ClientContext::run_due_refreshes()
+{
+    std::vector<ScheduledRefresh> batch;
+    {
+        std::lock_guard lock{this->refresh_mutex};
+        // The timer removes itself once this returns. Another thread may have replaced it while it
+        // was waiting for the lock, in which case the new timer is left alone
+        if(g_main_current_source() == this->refresh_timer) {
+            g_source_unref(this->refresh_timer);
+            this->refresh_timer = nullptr;
+        }
+
+        gint64 cutoff = g_get_real_time() + REFRESH_COALESCE_WINDOW;
+        while(!this->refreshes.empty() && batch.size() < REFRESH_BATCH_SIZE
+              && this->refreshes.begin()->first <= cutoff) {
+            auto entry = this->refreshes.begin();
+            this->refresh_owners.erase(entry->second.owner);
+            batch.push_back(std::move(entry->second));
+            this->refreshes.erase(entry);
+        }
+        if(!this->refreshes.empty()) {
+            gint64 next_due = this->refreshes.begin()->first;
+            if(next_due <= cutoff) {
+                arm_refresh_timer(REFRESH_BATCH_INTERVAL);
+            } else {
+                arm_refresh_timer((guint)((next_due - REFRESH_COALESCE_WINDOW - g_get_real_time()) / 1000));
+            }
+        }
+    }
+    for(auto& scheduled : batch) {
+        invoke_on(scheduled.context, std::move(scheduled.refresh));
+        g_main_context_unref(scheduled.context);
+    }
+}
+
+} // namespace youtube
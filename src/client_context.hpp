@@ -0,0 +1,161 @@
+/*
+BirdTube - YouTube live chat protocol plugin
+Copyright (C) 2026 Cole Blakley
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+#pragma once
+
+#include <atomic>
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <glib.h>
+#include <peel/RefPtr.h>
+#include <peel/Soup/Session.h>
+#include "youtube_types.hpp"
+
+namespace youtube {
+
+/* Process-wide resources that every ChatClient borrows, so that the cost of an idle account stays
+   small: a single HTTP session (and so a single pool of connections per host) for all API requests,
+   a single timer that refreshes every account's access token, and a single watch on connectivity
+   (network availability and system suspend). May be used from any thread */
+class ClientContext {
+public:
+    /* While held, the connection to a host is kept open between requests. Releases itself on
+       destruction */
+    class KeepWarm {
+    public:
+        KeepWarm() = default;
+        KeepWarm(const KeepWarm&) = delete;
+        KeepWarm(KeepWarm&& other) noexcept
+            : uri(std::exchange(other.uri, {})) {}
+        ~KeepWarm() noexcept
+        {
+            release();
+        }
+        KeepWarm& operator=(const KeepWarm&) = delete;
+        KeepWarm& operator=(KeepWarm&& other) noexcept
+        {
+            release();
+            uri = std::exchange(other.uri, {});
+            return *this;
+        }
+        void release() noexcept;
+    private:
+        friend class ClientContext;
+        explicit
+        KeepWarm(std::string uri)
+            : uri(std::move(uri)) {}
+
+        // Empty when not held
+        std::string uri;
+    };
+
+    // Called with false when requests can't currently succeed (no network, or the system was just
+    // suspended) and with true once they can again. Clients should hold off on their catch-up
+    // requests for resync_delay milliseconds after regaining connectivity, which spreads out the
+    // catch-up across clients
+    using ConnectivityCallback = std::move_only_function<void(bool is_available, guint resync_delay)>;
+
+    static ClientContext& get_default();
+
+    ClientContext(const ClientContext&) = delete;
+    ClientContext& operator=(const ClientContext&) = delete;
+
+    soup::Session* get_session() const { return session; }
+
+    // Starts opening a connection (including the TLS handshake) to the host of `uri` in the
+    // background, so that the first request to it doesn't have to wait for one. Does nothing if
+    // this was already done recently
+    void preconnect(const char* uri);
+    // Keeps the connection to the host of `uri` open (by preconnecting and, once it has been idle
+    // for a while, sending it a lightweight request) for as long as the returned handle is held
+    KeepWarm keep_warm(const char* uri);
+    // Call whenever a request is sent through the session
+    void note_activity() { last_activity.store(g_get_monotonic_time(), std::memory_order_relaxed); }
+    ConnectionWarmupStats get_warmup_stats() const;
+
+    // Arranges for `refresh` to be run on `context` at around due_time (in g_get_real_time() units).
+    // Refreshes that are due close together are grouped, but each group is limited in size and
+    // spaced out from the next, so that many accounts never refresh all at once. Replaces any
+    // refresh already scheduled for `owner`
+    void schedule_refresh(const void* owner, gint64 due_time, GMainContext* context,
+                          std::move_only_function<void()> refresh);
+    void cancel_refresh(const void* owner);
+
+    // `callback` is run on `context`
+    void add_connectivity_listener(const void* owner, GMainContext* context, ConnectivityCallback callback);
+    void remove_connectivity_listener(const void* owner);
+    bool is_network_available() const { return network_available.load(std::memory_order_relaxed); }
+private:
+    struct ConnectivityListener {
+        ConnectivityCallback callback;
+        // Set once removed, in case a notification is still on its way
+        std::atomic<bool> is_removed = false;
+    };
+
+    struct ScheduledRefresh {
+        const void* owner;
+        // Owns a reference
+        GMainContext* context;
+        std::move_only_function<void()> refresh;
+    };
+    using RefreshQueue = std::multimap<gint64, ScheduledRefresh>;
+
+    ClientContext();
+    void arm_refresh_timer(guint delay);
+    void run_due_refreshes();
+    void release_warm(const std::string& uri);
+    void send_keepalives();
+    void notify_connectivity(bool is_available);
+    void check_for_clock_jump();
+
+    peel::RefPtr<soup::Session> session;
+
+    std::mutex warm_mutex;
+    // Monotonic time of the last preconnect to each URI
+    std::unordered_map<std::string, gint64> last_preconnects;
+    // Number of KeepWarm handles held for each URI
+    std::unordered_map<std::string, std::size_t> warm_uris;
+    // Runs on the global default context while any URI is being kept warm
+    guint keepalive_source = 0;
+    // Monotonic time of the last request sent through the session
+    std::atomic<gint64> last_activity = 0;
+    std::atomic<guint64> preconnect_count = 0;
+    std::atomic<guint64> keepalive_count = 0;
+
+    std::mutex refresh_mutex;
+    // Ordered by due time
+    RefreshQueue refreshes;
+    std::unordered_map<const void*, RefreshQueue::iterator> refresh_owners;
+    // Attached to the global default context
+    GSource* refresh_timer = nullptr;
+
+    std::mutex connectivity_mutex;
+    std::unordered_map<const void*, std::pair<GMainContext*, std::shared_ptr<ConnectivityListener>>>
+        connectivity_listeners;
+    std::atomic<bool> network_available = true;
+    // Real and monotonic times of the last clock check; a mismatch between how much each has
+    // advanced means the system was suspended or the wall clock was changed
+    gint64 last_real_time = 0;
+    gint64 last_monotonic_time = 0;
+};
+
+} // namespace youtube
@@ -22,15 +22,19 @@ along with this program.  If not, see <https://www.gnu.org/licenses/>.
 class EventSourceToken {
 public:
     EventSourceToken()
-        : source_id(0) {}
+        : source_id(0), context(nullptr) {}
     explicit
     EventSourceToken(guint source_id)
-        : source_id(source_id) {}
+        : source_id(source_id), context(nullptr) {}
+    // For sources attached to a main context other than the global default one
+    EventSourceToken(guint source_id, GMainContext* context)
+        : source_id(source_id), context(context ? g_main_context_ref(context) : nullptr) {}
     EventSourceToken(const EventSourceToken&) = delete;
     EventSourceToken(EventSourceToken&& other) noexcept
-        : source_id(other.source_id)
+        : source_id(other.source_id), context(other.context)
     {
         other.source_id = 0;
+        other.context = nullptr;
     }
     ~EventSourceToken() noexcept
     {
@@ -41,7 +45,9 @@ public:
     {
         disconnect();
         source_id = other.source_id;
+        context = other.context;
         other.source_id = 0;
+        other.context = nullptr;
         return *this;
     }
     EventSourceToken& operator=(guint new_source_id) noexcept
@@ -50,15 +56,34 @@ public:
         source_id = new_source_id;
         return *this;
     }
+    // Forget the source without removing it (e.g. because its callback returned G_SOURCE_REMOVE)
+    void release() noexcept
+    {
+        source_id = 0;
+    }
+    explicit operator bool() const noexcept
+    {
+        return source_id != 0;
+    }
     void disconnect() noexcept
     {
         if(source_id) {
-            if(!g_source_remove(source_id)) {
+            if(context) {
+                // One-shot sources remove themselves once they fire, so a missing source is expected
+                if(auto* source = g_main_context_find_source_by_id(context, source_id)) {
+                    g_source_destroy(source);
+                }
+            } else if(!g_source_remove(source_id)) {
                 g_warning("Failed to remove event source: %d", source_id);
             }
             source_id = 0;
         }
+        if(context) {
+            g_main_context_unref(context);
+            context = nullptr;
+        }
     }
 private:
     guint source_id;
+    GMainContext* context;
 };
@@ -0,0 +1,131 @@
+/*
+BirdTube - YouTube live chat protocol plugin
+Copyright (C) 2026 Cole Blakley
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <new>
+
+/* Allocator for coroutine frames. Frames are grouped into size classes, and freed frames are kept on
+   a per-thread free list for their size class so that coroutines that are repeatedly created (e.g.
+   once per poll) reuse the same memory instead of going through the heap each time */
+namespace frame_pool {
+
+inline constexpr std::size_t size_class_granularity = 64;
+inline constexpr std::size_t size_class_count = 16;
+// Upper bound on the number of free frames kept per size class (per thread)
+inline constexpr std::size_t max_free_frames = 64;
+
+#ifndef NDEBUG
+// Number of frames that have been allocated but not freed (across all threads). Useful for
+// catching tasks that are never resumed to completion
+inline std::atomic<std::size_t> live_frames = 0;
+#endif
+
+class FreeLists {
+public:
+    FreeLists() = default;
+    FreeLists(const FreeLists&) = delete;
+    FreeLists& operator=(const FreeLists&) = delete;
+    ~FreeLists() noexcept
+    {
+        for(auto& list : lists) {
+            while(list.head) {
+                FreeFrame* next = list.head->next;
+                ::operator delete(list.head);
+                list.head = next;
+            }
+        }
+    }
+
+    void* allocate(std::size_t size_class)
+    {
+        auto& list = lists[size_class];
+        if(!list.head) {
+            return ::operator new((size_class + 1) * size_class_granularity);
+        }
+        FreeFrame* frame = list.head;
+        list.head = frame->next;
+        --list.length;
+        return frame;
+    }
+
+    void deallocate(void* ptr, std::size_t size_class)
+    {
+        auto& list = lists[size_class];
+        if(list.length >= max_free_frames) {
+            ::operator delete(ptr);
+            return;
+        }
+        list.head = ::new(ptr) FreeFrame{list.head};
+        ++list.length;
+    }
+private:
+    struct FreeFrame {
+        FreeFrame* next;
+    };
+    struct FreeList {
+        FreeFrame* head = nullptr;
+        std::size_t length = 0;
+    };
+
+    std::array<FreeList, size_class_count> lists;
+};
+
+inline FreeLists& get_free_lists()
+{
+    thread_local FreeLists free_lists;
+    return free_lists;
+}
+
+inline void* allocate(std::size_t size)
+{
+    #ifndef NDEBUG
+    live_frames.fetch_add(1, std::memory_order_relaxed);
+    #endif
+    std::size_t size_class = (size - 1) / size_class_granularity;
+    if(size_class >= size_class_count) {
+        return ::operator new(size);
+    }
+    return get_free_lists().allocate(size_class);
+}
+
+inline void deallocate(void* ptr, std::size_t size)
+{
+    #ifndef NDEBUG
+    live_frames.fetch_sub(1, std::memory_order_relaxed);
+    #endif
+    std::size_t size_class = (size - 1) / size_class_granularity;
+    if(size_class >= size_class_count) {
+        ::operator delete(ptr);
+        return;
+    }
+    get_free_lists().deallocate(ptr, size_class);
+}
+
+inline std::size_t get_live_frame_count()
+{
+    #ifndef NDEBUG
+    return live_frames.load(std::memory_order_relaxed);
+    #else
+    return 0;
+    #endif
+}
+
+} // namespace frame_pool
@@ -0,0 +1,112 @@
+/*
+BirdTube - YouTube live chat protocol plugin
+Copyright (C) 2026 Cole Blakley
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <bit>
+#include <cstddef>
+#include <glib.h>
+
+/* Histogram of durations (in microseconds) with logarithmic buckets, HDR histogram style: each power
+   of two is split into 4 sub-buckets, so any recorded value is off by at most 25%, and everything
+   from 1 us to about 9 minutes fits in a fixed 112 buckets (longer values land in the last one).
+   Recording is lock-free and can happen from any thread */
+class LatencyHistogram {
+public:
+    static constexpr unsigned SUB_BUCKET_BITS = 2;
+    static constexpr unsigned MAX_EXPONENT = 27;
+    static constexpr std::size_t BUCKET_COUNT = (MAX_EXPONENT + 1) << SUB_BUCKET_BITS;
+
+    /* Copy of the counts at some point in time */
+    struct Snapshot {
+        std::array<guint64, BUCKET_COUNT> counts{};
+        guint64 total = 0;
+
+        // Upper bound (in microseconds) on the given fraction (0 to 1) of the recorded values, e.g.
+        // 0.99 for the 99th percentile. 0 if nothing has been recorded
+        guint64 get_percentile(double fraction) const
+        {
+            if(total == 0) {
+                return 0;
+            }
+            auto rank = (guint64)(std::clamp(fraction, 0.0, 1.0) * (double)total);
+            guint64 seen = 0;
+            for(std::size_t i = 0; i < BUCKET_COUNT; ++i) {
+                seen += counts[i];
+                if(seen > rank || seen == total) {
+                    return get_bucket_end(i);
+                }
+            }
+            return get_bucket_end(BUCKET_COUNT - 1);
+        }
+
+        // Values recorded between `earlier` (a snapshot of the same histogram) and this snapshot
+        Snapshot since(const Snapshot& earlier) const
+        {
+            Snapshot result;
+            for(std::size_t i = 0; i < BUCKET_COUNT; ++i) {
+                result.counts[i] = counts[i] - earlier.counts[i];
+            }
+            result.total = total - earlier.total;
+            return result;
+        }
+    };
+
+    void record(gint64 value)
+    {
+        counts[get_bucket(value)].fetch_add(1, std::memory_order_relaxed);
+    }
+
+    Snapshot snapshot() const
+    {
+        Snapshot result;
+        for(std::size_t i = 0; i < BUCKET_COUNT; ++i) {
+            result.counts[i] = counts[i].load(std::memory_order_relaxed);
+            result.total += result.counts[i];
+        }
+        return result;
+    }
+
+    static std::size_t get_bucket(gint64 value)
+    {
+        auto v = (guint64)std::max<gint64>(value, 0);
+        if(v < (1u << SUB_BUCKET_BITS)) {
+            return v;
+        }
+        unsigned exponent = std::bit_width(v) - 1;
+        std::size_t sub_bucket = (v >> (exponent - SUB_BUCKET_BITS)) & ((1u << SUB_BUCKET_BITS) - 1);
+        std::size_t bucket = ((exponent - SUB_BUCKET_BITS + 1) << SUB_BUCKET_BITS) | sub_bucket;
+        return std::min(bucket, BUCKET_COUNT - 1);
+    }
+
+    // Smallest value that falls in the bucket after the given one
+    static guint64 get_bucket_end(std::size_t bucket)
+    {
+        std::size_t next = bucket + 1;
+        if(next < (1u << SUB_BUCKET_BITS)) {
+            return next;
+        }
+        unsigned exponent = (unsigned)(next >> SUB_BUCKET_BITS) + SUB_BUCKET_BITS - 1;
+        guint64 sub_bucket = next & ((1u << SUB_BUCKET_BITS) - 1);
+        return ((1ull << SUB_BUCKET_BITS) | sub_bucket) << (exponent - SUB_BUCKET_BITS);
+    }
+private:
+    std::array<std::atomic<guint64>, BUCKET_COUNT> counts{};
+};
@@ -0,0 +1,133 @@
+/*
+BirdTube - YouTube live chat protocol plugin
+Copyright (C) 2026 Cole Blakley
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+#include "live_chat_registry.hpp"
+#include <algorithm>
+#include <utility>
+
+namespace youtube {
+
+LiveChatRegistry& LiveChatRegistry::get_default()
+{
+    static LiveChatRegistry registry;
+    return registry;
+}
+
+bool LiveChatRegistry::join(const char* live_chat_id, std::shared_ptr<LiveChatSubscriber> subscriber)
+{
+    std::lock_guard lock{this->mutex};
+    auto& chat = this->chats[live_chat_id];
+    chat.subscribers.push_back(std::move(subscriber));
+    return chat.subscribers.size() == 1;
+}
+
+void LiveChatRegistry::leave(const char* live_chat_id, const LiveChatSubscriber* subscriber)
+{
+    std::shared_ptr<LiveChatSubscriber> new_fetcher;
+    guint poll_interval = 0;
+    peel::String next_page_token;
+    {
+        std::lock_guard lock{this->mutex};
+        auto chat = this->chats.find(live_chat_id);
+        if(chat == this->chats.end()) {
+            return;
+        }
+        auto& subscribers = chat->second.subscribers;
+        auto match = std::ranges::find_if(subscribers, [subscriber](const auto& entry) {
+            return entry.get() == subscriber;
+        });
+        if(match == subscribers.end()) {
+            return;
+        }
+        bool was_fetcher = match == subscribers.begin();
+        subscribers.erase(match);
+        if(subscribers.empty()) {
+            this->chats.erase(chat);
+            return;
+        }
+        if(was_fetcher) {
+            new_fetcher = subscribers.front();
+            poll_interval = chat->second.poll_interval;
+            if(!chat->second.next_page_token.empty()) {
+                next_page_token = chat->second.next_page_token.c_str();
+            }
+        }
+    }
+    // Called without the lock held, in case the subscriber calls back into the registry
+    if(new_fetcher) {
+        new_fetcher->on_promoted(poll_interval, std::move(next_page_token));
+    }
+}
+
+void LiveChatRegistry::publish(const char* live_chat_id, const LiveChatSubscriber* fetcher,
+                               peel::RefPtr<MessageBatch> batch, guint poll_interval, const char* next_page_token)
+{
+    std::vector<std::shared_ptr<LiveChatSubscriber>> followers;
+    {
+        std::lock_guard lock{this->mutex};
+        auto chat = this->chats.find(live_chat_id);
+        // The fetcher may have left while its last poll was in flight
+        if(chat == this->chats.end() || chat->second.subscribers.front().get() != fetcher) {
+            return;
+        }
+        chat->second.poll_interval = poll_interval;
+        chat->second.next_page_token = next_page_token ? next_page_token : "";
+        if(batch) {
+            followers.assign(chat->second.subscribers.begin() + 1, chat->second.subscribers.end());
+        }
+    }
+    for(auto& follower : followers) {
+        follower->on_batch(batch);
+    }
+}
+
+std::size_t LiveChatRegistry::get_subscriber_count(const char* live_chat_id) const
+{
+    std::lock_guard lock{this->mutex};
+    auto chat = this->chats.find(live_chat_id);
+    return chat == this->chats.end() ? 0 : chat->second.subscribers.size();
+}
+
+ChatPriority LiveChatRegistry::get_priority(const char* live_chat_id) const
+{
+    std::lock_guard lock{this->mutex};
+    auto chat = this->chats.find(live_chat_id);
+    if(chat == this->chats.end()) {
+        return ChatPriority::Normal;
+    }
+    auto priority = ChatPriority::Background;
+    for(const auto& subscriber : chat->second.subscribers) {
+        priority = std::max(priority, subscriber->get_priority());
+    }
+    return priority;
+}
+
+void LiveChatRegistry::update_priority(const char* live_chat_id)
+{
+    std::shared_ptr<LiveChatSubscriber> fetcher;
+    {
+        std::lock_guard lock{this->mutex};
+        auto chat = this->chats.find(live_chat_id);
+        if(chat == this->chats.end()) {
+            return;
+        }
+        fetcher = chat->second.subscribers.front();
+    }
+    fetcher->on_priority_changed();
+}
+
+} // namespace youtube
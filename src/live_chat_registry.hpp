@@ -0,0 +1,84 @@
+/*
+BirdTube - YouTube live chat protocol plugin
+Copyright (C) 2026 Cole Blakley
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+#pragma once
+
+#include <cstddef>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include <glib.h>
+#include <peel/RefPtr.h>
+#include <peel/String.h>
+#include "message_batch.hpp"
+
+namespace youtube {
+
+/* A conversation's membership in the LiveChatRegistry. The registry may call these from any thread,
+   so implementations are responsible for getting back onto their own context */
+class LiveChatSubscriber {
+public:
+    virtual ~LiveChatSubscriber() = default;
+    // A batch of messages that was fetched by the chat's fetcher
+    virtual void on_batch(peel::RefPtr<MessageBatch>) = 0;
+    // The previous fetcher left, so this subscriber should start polling from where it left off
+    virtual void on_promoted(guint poll_interval, peel::String next_page_token) = 0;
+    // How eagerly this subscriber wants the chat polled
+    virtual ChatPriority get_priority() const = 0;
+    // Only called on the fetcher: the priority of the chat (see LiveChatRegistry::get_priority())
+    // may have changed
+    virtual void on_priority_changed() = 0;
+};
+
+/* Process-wide table of the live chats being received, keyed by live chat ID. When several clients
+   (i.e. accounts) are in the same chat, only one of them (the fetcher) polls it, and each batch it
+   receives is passed on to the others. If the fetcher leaves, the longest-joined remaining subscriber
+   takes over from the fetcher's last page token, so nothing is missed or received twice. The fetcher
+   polls as eagerly as the most eager subscriber wants. Sending messages is unaffected; each client
+   still does that itself */
+class LiveChatRegistry {
+public:
+    static LiveChatRegistry& get_default();
+
+    // Returns true if the subscriber is now the chat's fetcher and should start polling
+    bool join(const char* live_chat_id, std::shared_ptr<LiveChatSubscriber>);
+    void leave(const char* live_chat_id, const LiveChatSubscriber*);
+    // Called by the fetcher after every successful poll. `batch` may be null if there were no new
+    // messages; it is passed on to all of the other subscribers
+    void publish(const char* live_chat_id, const LiveChatSubscriber* fetcher, peel::RefPtr<MessageBatch> batch,
+                 guint poll_interval, const char* next_page_token);
+    std::size_t get_subscriber_count(const char* live_chat_id) const;
+    // Highest priority among the chat's subscribers, which the fetcher should poll at
+    ChatPriority get_priority(const char* live_chat_id) const;
+    // Call after a subscriber's priority changes, so the fetcher can adjust
+    void update_priority(const char* live_chat_id);
+private:
+    struct Chat {
+        // The first subscriber is the fetcher
+        std::vector<std::shared_ptr<LiveChatSubscriber>> subscribers;
+        // Where the fetcher is up to, for handing over to the next one
+        guint poll_interval = 0;
+        std::string next_page_token;
+    };
+
+    mutable std::mutex mutex;
+    std::unordered_map<std::string, Chat> chats;
+};
+
+} // namespace youtube
@@ -0,0 +1,172 @@
+/*
+BirdTube - YouTube live chat protocol plugin
+Copyright (C) 2026 Cole Blakley
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+#pragma once
+
+#include <coroutine>
+#include <optional>
+#include <type_traits>
+#include <utility>
+#include <glib.h>
+#include "event_source_token.hpp"
+
+/* Helpers for running code on a specific GMainContext. These are needed because glib::timeout_add_once()
+   and friends always attach to the global default context, even when called from a thread that is
+   running its own context */
+
+/* True if code running in the calling thread is already running on (or is allowed to run on) the
+   given context */
+inline bool is_current_context(GMainContext* context)
+{
+    GMainContext* thread_default = g_main_context_get_thread_default();
+    if(!thread_default) {
+        thread_default = g_main_context_default();
+    }
+    return g_main_context_is_owner(context) || context == thread_default;
+}
+
+/* Runs the callback on the given context: immediately if the calling thread owns the context,
+   otherwise from that context's next main loop iteration */
+template<typename F>
+void invoke_on(GMainContext* context, F&& callback)
+{
+    using Callback = std::decay_t<F>;
+    g_main_context_invoke_full(context, G_PRIORITY_DEFAULT, [](gpointer data) -> gboolean {
+        (*static_cast<Callback*>(data))();
+        return G_SOURCE_REMOVE;
+    }, new Callback(std::forward<F>(callback)), [](gpointer data) {
+        delete static_cast<Callback*>(data);
+    });
+}
+
+/* Like invoke_on(), but always defers the callback to the context's next main loop iteration, even
+   when called from the thread that owns the context. Use this when running the callback right away
+   could re-enter the caller */
+template<typename F>
+void post_to(GMainContext* context, F&& callback)
+{
+    using Callback = std::decay_t<F>;
+    GSource* source = g_idle_source_new();
+    g_source_set_priority(source, G_PRIORITY_DEFAULT);
+    g_source_set_callback(source, [](gpointer data) -> gboolean {
+        (*static_cast<Callback*>(data))();
+        return G_SOURCE_REMOVE;
+    }, new Callback(std::forward<F>(callback)), [](gpointer data) {
+        delete static_cast<Callback*>(data);
+    });
+    g_source_attach(source, context);
+    g_source_unref(source);
+}
+
+/* Runs the callback on the given context and blocks until it has finished, returning its result.
+   Must not be used to call into a context whose thread might itself be blocked waiting on the
+   calling thread */
+template<typename F>
+auto invoke_on_sync(GMainContext* context, F&& callback) -> std::invoke_result_t<F&>
+{
+    using Result = std::invoke_result_t<F&>;
+    if(is_current_context(context)) {
+        return callback();
+    }
+
+    struct SyncState {
+        GMutex mutex;
+        GCond cond;
+        bool is_done = false;
+    } state;
+    g_mutex_init(&state.mutex);
+    g_cond_init(&state.cond);
+    [[maybe_unused]] std::conditional_t<std::is_void_v<Result>, bool, std::optional<Result>> result{};
+    invoke_on(context, [&] {
+        if constexpr(std::is_void_v<Result>) {
+            callback();
+        } else {
+            result.emplace(callback());
+        }
+        g_mutex_lock(&state.mutex);
+        state.is_done = true;
+        g_cond_signal(&state.cond);
+        g_mutex_unlock(&state.mutex);
+    });
+    g_mutex_lock(&state.mutex);
+    while(!state.is_done) {
+        g_cond_wait(&state.cond, &state.mutex);
+    }
+    g_mutex_unlock(&state.mutex);
+    g_cond_clear(&state.cond);
+    g_mutex_clear(&state.mutex);
+    if constexpr(!std::is_void_v<Result>) {
+        return std::move(*result);
+    }
+}
+
+/* Like glib::timeout_add_once(), but attaches to the calling thread's default main context */
+template<typename F>
+EventSourceToken timeout_add_once_local(guint interval, F&& callback)
+{
+    using Callback = std::decay_t<F>;
+    GMainContext* context = g_main_context_ref_thread_default();
+    GSource* source = g_timeout_source_new(interval);
+    g_source_set_callback(source, [](gpointer data) -> gboolean {
+        (*static_cast<Callback*>(data))();
+        return G_SOURCE_REMOVE;
+    }, new Callback(std::forward<F>(callback)), [](gpointer data) {
+        delete static_cast<Callback*>(data);
+    });
+    guint source_id = g_source_attach(source, context);
+    g_source_unref(source);
+    EventSourceToken token{source_id, context};
+    g_main_context_unref(context);
+    return token;
+}
+
+/* Awaitable that continues the awaiting coroutine after `interval` milliseconds, on the calling
+   thread's default main context */
+class SleepFor {
+public:
+    explicit
+    SleepFor(guint interval)
+        : interval(interval) {}
+
+    constexpr bool await_ready() const noexcept { return false; }
+    void await_suspend(std::coroutine_handle<> handle)
+    {
+        source = timeout_add_once_local(interval, [handle] { handle.resume(); });
+    }
+    void await_resume() noexcept { source.release(); }
+private:
+    guint interval;
+    EventSourceToken source;
+};
+
+/* Awaitable that continues the awaiting coroutine on the given context. Does not suspend if
+   the coroutine is already running on that context */
+class ResumeOn {
+public:
+    explicit
+    ResumeOn(GMainContext* context)
+        : context(context) {}
+
+    bool await_ready() const noexcept { return is_current_context(context); }
+    void await_suspend(std::coroutine_handle<> handle)
+    {
+        invoke_on(context, [handle] { handle.resume(); });
+    }
+    constexpr void await_resume() const noexcept {}
+private:
+    GMainContext* context;
+};
@@ -0,0 +1,36 @@
+/*
+BirdTube - YouTube live chat protocol plugin
+Copyright (C) 2026 Cole Blakley
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+#include "message_batch.hpp"
+#include <utility>
+
+namespace youtube {
+
+PEEL_CLASS_IMPL(MessageBatch, "YoutubeMessageBatch", gobject::Object)
+
+void MessageBatch::Class::init()
+{}
+
+peel::RefPtr<MessageBatch> MessageBatch::create(std::vector<ChatMessage> messages, BatchTimestamps timestamps)
+{
+    auto batch = Object::create<MessageBatch>();
+    batch->messages = std::move(messages);
+    batch->timestamps = timestamps;
+    return batch;
+}
+
+} // namespace youtube
@@ -0,0 +1,64 @@
+/*
+BirdTube - YouTube live chat protocol plugin
+Copyright (C) 2026 Cole Blakley
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+#pragma once
+
+#include <cstddef>
+#include <vector>
+#include <glib.h>
+#include <peel/ArrayRef.h>
+#include <peel/GObject/GObject.h>
+#include <peel/RefPtr.h>
+#include <peel/class.h>
+#include "youtube_types.hpp"
+
+namespace youtube {
+
+/* When a batch made its way through the client, as local wall clock times (g_get_real_time(), in
+   microseconds). Together with the messages' publish times, these show where delivery time goes */
+struct BatchTimestamps {
+    // The poll response finished arriving
+    gint64 received_at = 0;
+    // The response was parsed into messages
+    gint64 parsed_at = 0;
+    // Estimated difference between the server's clock and the local clock (server minus local)
+    // when the batch arrived. Add it to a local time to compare it with a publish time
+    gint64 clock_offset = 0;
+};
+
+/* Immutable set of chat messages received in a single poll. Refcounted so that any number of
+   consumers can hold on to it past the signal emission (or pass it to another thread) without
+   copying the messages; they are freed once the last reference is dropped */
+class MessageBatch final : public gobject::Object {
+    PEEL_SIMPLE_CLASS(MessageBatch, Object)
+public:
+    void init(Class*) {}
+    static peel::RefPtr<MessageBatch> create(std::vector<ChatMessage> messages, BatchTimestamps = {});
+
+    peel::ArrayRef<const ChatMessage> get_messages() const { return {messages.data(), messages.size()}; }
+    std::size_t size() const { return messages.size(); }
+    bool empty() const { return messages.empty(); }
+    const ChatMessage& operator[](std::size_t i) const { return messages[i]; }
+    std::vector<ChatMessage>::const_iterator begin() const { return messages.begin(); }
+    std::vector<ChatMessage>::const_iterator end() const { return messages.end(); }
+    const BatchTimestamps& get_timestamps() const { return timestamps; }
+private:
+    std::vector<ChatMessage> messages;
+    BatchTimestamps timestamps;
+};
+
+} // namespace youtube
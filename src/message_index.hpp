@@ -0,0 +1,104 @@
+/*
+BirdTube - YouTube live chat protocol plugin
+Copyright (C) 2026 Cole Blakley
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+#pragma once
+
+#include <cstddef>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+/* Maps the IDs of the most recent messages in a conversation to a value (e.g. the message as
+   shown to the user). Holds at most `capacity` entries; once full, each insertion overwrites the
+   oldest entry, so memory use stays flat no matter how long a stream runs. Lookups are O(1). */
+template<typename T>
+class MessageIndex {
+public:
+    explicit
+    MessageIndex(std::size_t capacity = 0)
+        : max_entries(capacity)
+    {}
+    MessageIndex(const MessageIndex&) = delete;
+    MessageIndex& operator=(const MessageIndex&) = delete;
+
+    void set_capacity(std::size_t capacity)
+    {
+        clear();
+        max_entries = capacity;
+    }
+
+    void insert(std::string_view id, T value)
+    {
+        if(max_entries == 0) {
+            return;
+        }
+        if(auto match = lookup.find(id); match != lookup.end()) {
+            entries[match->second].value = std::move(value);
+            return;
+        }
+        if(entries.size() < max_entries) {
+            // Reserve everything up front: the lookup table keys point into the entries'
+            // strings, so the entries must never be reallocated
+            if(entries.empty()) {
+                entries.reserve(max_entries);
+                lookup.reserve(max_entries);
+            }
+            entries.push_back({std::string{id}, std::move(value)});
+            lookup.emplace(entries.back().id, entries.size() - 1);
+            return;
+        }
+        // Overwrite the oldest entry
+        Entry& oldest = entries[next];
+        lookup.erase(oldest.id);
+        oldest.id.assign(id);
+        oldest.value = std::move(value);
+        lookup.emplace(oldest.id, next);
+        next = (next + 1) % max_entries;
+    }
+
+    T* find(std::string_view id)
+    {
+        auto match = lookup.find(id);
+        if(match == lookup.end()) {
+            return nullptr;
+        }
+        return &entries[match->second].value;
+    }
+
+    void clear()
+    {
+        lookup.clear();
+        entries.clear();
+        entries.shrink_to_fit();
+        next = 0;
+    }
+
+    std::size_t size() const { return entries.size(); }
+    std::size_t capacity() const { return max_entries; }
+private:
+    struct Entry {
+        std::string id;
+        T value;
+    };
+
+    std::size_t max_entries;
+    // Index of the entry that will be overwritten next once the index is full
+    std::size_t next = 0;
+    std::vector<Entry> entries;
+    std::unordered_map<std::string_view, std::size_t> lookup;
+};
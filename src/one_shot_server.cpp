@@ -18,6 +18,7 @@ along with this program.  If not, see <https://www.gnu.org/licenses/>.
 #include "one_shot_server.hpp"
 #include <peel/Soup/ServerListenOptions.h>
 #include "youtube_error.h"
+#include "main_context.hpp"
 
 /* Awaiter for server listen() async operation */
 class ServerListenResult {
@@ -35,6 +36,12 @@ public:
             handle.resume();
         };
     }
+    // Resumes without a request (msg stays null)
+    void time_out()
+    {
+        assert(handle);
+        handle.resume();
+    }
     soup::ServerMessage* msg = nullptr;
     glib::HashTable* query = nullptr;
 private:
@@ -76,18 +83,28 @@ peel::RefPtr<OneShotServer> OneShotServer::create()
     return Object::create<OneShotServer>();
 }
 
-Task<peel::RefPtr<glib::HashTable>> OneShotServer::listen(unsigned port)
+Task<peel::RefPtr<glib::HashTable>> OneShotServer::listen(unsigned port, guint timeout_ms)
 {
     ServerListenResult result;
     peel::UniquePtr<glib::Error> error;
     this->server->add_handler("/", result.callback());
-    // TODO: timeout for server?
     this->server->listen_local(port, soup::ServerListenOptions::IPV4_ONLY, &error);
     if(error) {
         co_return std::unexpected(std::move(error));
     }
 
+    EventSourceToken timeout_source;
+    if(timeout_ms) {
+        timeout_source = timeout_add_once_local(timeout_ms, [&result] { result.time_out(); });
+    }
     co_await result;
+    timeout_source.disconnect();
+    if(!result.msg) {
+        this->server->remove_handler("/");
+        this->server->disconnect();
+        co_return std::unexpected(ErrorPtr(YOUTUBE_CHAT_ERROR, YOUTUBE_CHAT_ERROR_TIMED_OUT,
+                                           "No response received within %u seconds", timeout_ms / 1000));
+    }
     this->msg = result.msg;
     this->msg->pause();
     peel::RefPtr query = result.query;
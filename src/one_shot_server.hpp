@@ -39,7 +39,8 @@ public:
     void init(Class*);
     static peel::RefPtr<OneShotServer> create();
 
-    Task<peel::RefPtr<glib::HashTable>> listen(unsigned port);
+    // Waits for a request for at most timeout_ms milliseconds (0 = wait forever)
+    Task<peel::RefPtr<glib::HashTable>> listen(unsigned port, guint timeout_ms = 0);
     Task<void> respond(soup::Status, soup::MemoryUse mem_use, peel::ArrayRef<const uint8_t> content);
     Task<void> respond(soup::Status, peel::String content);
 private:
@@ -0,0 +1,117 @@
+/*
+BirdTube - YouTube live chat protocol plugin
+Copyright (C) 2026 Cole Blakley
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+#pragma once
+
+#include <cstddef>
+#include <deque>
+#include <optional>
+#include <utility>
+#include <vector>
+#include <glib.h>
+
+/* Stores values in slots that are addressed by a Key (a struct with `index` and `generation`
+   members) instead of by pointer or iterator. Lookups are a bounds check and a generation compare.
+   Erasing a value bumps its slot's generation, so keys to it stop resolving instead of dangling,
+   even once the slot has been reused. Values never move once inserted. Not thread-safe */
+template<typename T, typename Key>
+class SlotMap {
+public:
+    SlotMap() = default;
+    SlotMap(const SlotMap&) = delete;
+    SlotMap& operator=(const SlotMap&) = delete;
+
+    // Constructs the value in place as T(key, args...), where `key` is the new value's key
+    template<typename ...Args>
+    T& emplace(Args&&... args)
+    {
+        guint32 index;
+        if(!free_slots.empty()) {
+            index = free_slots.back();
+            free_slots.pop_back();
+        } else {
+            index = (guint32)slots.size();
+            slots.emplace_back();
+        }
+        Slot& slot = slots[index];
+        slot.value.emplace(Key{index, slot.generation}, std::forward<Args>(args)...);
+        ++count;
+        return *slot.value;
+    }
+
+    // Null if the value has been erased
+    T* get(Key key)
+    {
+        if(key.index >= slots.size() || slots[key.index].generation != key.generation) {
+            return nullptr;
+        }
+        auto& value = slots[key.index].value;
+        return value ? &*value : nullptr;
+    }
+    const T* get(Key key) const
+    {
+        return const_cast<SlotMap*>(this)->get(key);
+    }
+
+    void erase(Key key)
+    {
+        if(!get(key)) {
+            return;
+        }
+        Slot& slot = slots[key.index];
+        // Bumped first so that the key already fails to resolve while the value is being destroyed.
+        // 0 is skipped so that a zeroed key never resolves
+        if(++slot.generation == 0) {
+            slot.generation = 1;
+        }
+        slot.value.reset();
+        free_slots.push_back(key.index);
+        --count;
+    }
+
+    void clear()
+    {
+        for(guint32 i = 0; i < slots.size(); ++i) {
+            if(slots[i].value) {
+                erase(Key{i, slots[i].generation});
+            }
+        }
+    }
+
+    // Calls callback(T&) for each value. The callback must not insert or erase values
+    template<typename F>
+    void for_each(F&& callback)
+    {
+        for(auto& slot : slots) {
+            if(slot.value) {
+                callback(*slot.value);
+            }
+        }
+    }
+
+    std::size_t size() const { return count; }
+private:
+    struct Slot {
+        std::optional<T> value;
+        guint32 generation = 1;
+    };
+
+    // A deque so that growing it doesn't move existing values
+    std::deque<Slot> slots;
+    std::vector<guint32> free_slots;
+    std::size_t count = 0;
+};
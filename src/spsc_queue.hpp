@@ -0,0 +1,76 @@
+/*
+BirdTube - YouTube live chat protocol plugin
+Copyright (C) 2026 Cole Blakley
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+#pragma once
+
+#include <atomic>
+#include <optional>
+#include <utility>
+
+/* Unbounded lock-free queue for passing values from exactly one producer thread to exactly one
+   consumer thread */
+template<typename T>
+class SpscQueue {
+public:
+    SpscQueue()
+        : head(new Node), tail(head)
+    {}
+    SpscQueue(const SpscQueue&) = delete;
+    SpscQueue& operator=(const SpscQueue&) = delete;
+    ~SpscQueue() noexcept
+    {
+        while(head) {
+            Node* next = head->next.load(std::memory_order_relaxed);
+            delete head;
+            head = next;
+        }
+    }
+
+    // Only call from the producer thread
+    void push(T value)
+    {
+        Node* node = new Node;
+        node->value.emplace(std::move(value));
+        tail->next.store(node, std::memory_order_release);
+        tail = node;
+    }
+
+    // Only call from the consumer thread
+    std::optional<T> pop()
+    {
+        Node* next = head->next.load(std::memory_order_acquire);
+        if(!next) {
+            return {};
+        }
+        // `next` becomes the new dummy node at the front of the list
+        std::optional<T> result = std::move(next->value);
+        next->value.reset();
+        delete head;
+        head = next;
+        return result;
+    }
+private:
+    struct Node {
+        std::atomic<Node*> next = nullptr;
+        std::optional<T> value;
+    };
+
+    // Owned by the consumer
+    Node* head;
+    // Owned by the producer
+    Node* tail;
+};
@@ -26,6 +26,7 @@ along with this program.  If not, see <https://www.gnu.org/licenses/>.
 #include <peel/GLib/Error.h>
 #include <peel/UniquePtr.h>
 #include "error_wrapper.hpp"
+#include "frame_pool.hpp"
 
 namespace peel {
     namespace GObject {
@@ -44,7 +45,14 @@ struct awaiter_base {
     constexpr void await_resume() const noexcept {}
 };
 
-struct promise_type_base {
+/* Coroutine frames are allocated from a pool, since tasks are created and destroyed at a steady rate
+   (several per poll) */
+struct pooled_promise {
+    static void* operator new(std::size_t size) { return frame_pool::allocate(size); }
+    static void operator delete(void* ptr, std::size_t size) { frame_pool::deallocate(ptr, size); }
+};
+
+struct promise_type_base : public pooled_promise {
     constexpr std::suspend_always initial_suspend() const noexcept { return {}; }
     void unhandled_exception() { std::terminate(); }
 
@@ -141,7 +149,7 @@ private:
    Suitable for top level coroutines that start off async operations */
 class [[nodiscard]] VoidTask {
 public:
-    struct promise_type {
+    struct promise_type : public pooled_promise {
         struct FinalAwaitable : public awaiter_base {
             void await_suspend(std::coroutine_handle<promise_type> handle) const noexcept
             {
@@ -0,0 +1,313 @@
+/*
+BirdTube - YouTube live chat protocol plugin
+Copyright (C) 2026 Cole Blakley
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+#pragma once
+
+#include <array>
+#include <concepts>
+#include <coroutine>
+#include <cstddef>
+#include <expected>
+#include <optional>
+#include <tuple>
+#include <type_traits>
+#include <utility>
+#include <vector>
+#include <gio/gio.h>
+#include <peel/Gio/Cancellable.h>
+#include "task.hpp"
+#include "main_context.hpp"
+#include "youtube_error.h"
+
+/* Awaitables that run several Tasks concurrently. The tasks are all started from (and so run on)
+   the awaiting coroutine's main context; none of this is thread-safe. Each task's outcome is
+   reported as a std::expected, so that one failing task does not hide the results of the others */
+
+/* Outcome of a Task<T>, as a std::expected even when T is void */
+template<typename T>
+using TaskResult = std::expected<T, ErrorPtr>;
+
+template<typename T>
+struct task_value;
+
+template<typename T>
+struct task_value<Task<T>> {
+    using type = T;
+};
+
+template<typename T>
+TaskResult<T> to_task_result(typename Task<T>::ResultT&& result)
+{
+    if constexpr(std::same_as<T, void>) {
+        if(result) {
+            return std::unexpected(std::move(result));
+        }
+        return {};
+    } else {
+        return std::move(result);
+    }
+}
+
+/* Shared bookkeeping: counts outstanding tasks and resumes the awaiting coroutine once the last
+   one finishes. The count starts one higher than the number of tasks so that tasks which complete
+   without suspending can't resume the caller before await_suspend() has returned */
+class TaskGroup {
+protected:
+    void begin(std::coroutine_handle<> awaiting, std::size_t task_count)
+    {
+        caller = awaiting;
+        remaining = task_count + 1;
+    }
+
+    // Returns true if the caller should stay suspended (i.e. some task is still running)
+    bool end_start()
+    {
+        return --remaining != 0;
+    }
+
+    void task_done()
+    {
+        if(--remaining == 0) {
+            caller.resume();
+        }
+    }
+private:
+    std::coroutine_handle<> caller;
+    std::size_t remaining = 0;
+};
+
+/* Awaitable returned by when_all(Task<Ts>&&...) */
+template<typename ...Ts>
+class WhenAll : private TaskGroup {
+public:
+    explicit
+    WhenAll(Task<Ts>&... to_run)
+        : tasks(&to_run...) {}
+
+    constexpr bool await_ready() const noexcept { return sizeof...(Ts) == 0; }
+
+    bool await_suspend(std::coroutine_handle<> awaiting)
+    {
+        begin(awaiting, sizeof...(Ts));
+        [this]<std::size_t ...I>(std::index_sequence<I...>) {
+            (run_task<I>().start(), ...);
+        }(std::index_sequence_for<Ts...>{});
+        return end_start();
+    }
+
+    std::tuple<TaskResult<Ts>...> await_resume()
+    {
+        return [this]<std::size_t ...I>(std::index_sequence<I...>) {
+            return std::tuple<TaskResult<Ts>...>{std::move(*std::get<I>(results))...};
+        }(std::index_sequence_for<Ts...>{});
+    }
+private:
+    template<std::size_t I>
+    VoidTask run_task()
+    {
+        using T = std::tuple_element_t<I, std::tuple<Ts...>>;
+        Task<T>& task = *std::get<I>(tasks);
+        auto result = co_await task;
+        std::get<I>(results).emplace(to_task_result<T>(std::move(result)));
+        task_done();
+    }
+
+    std::tuple<Task<Ts>*...> tasks;
+    std::tuple<std::optional<TaskResult<Ts>>...> results;
+};
+
+/* Awaitable returned by when_all(count, make_task) */
+template<typename F>
+class WhenAllRange : private TaskGroup {
+public:
+    using T = typename task_value<std::invoke_result_t<F&, std::size_t>>::type;
+
+    WhenAllRange(std::size_t count, F make_task)
+        : make_task(std::move(make_task)), results(count) {}
+
+    bool await_ready() const noexcept { return results.empty(); }
+
+    bool await_suspend(std::coroutine_handle<> awaiting)
+    {
+        begin(awaiting, results.size());
+        for(std::size_t i = 0; i < results.size(); ++i) {
+            run_task(i).start();
+        }
+        return end_start();
+    }
+
+    std::vector<TaskResult<T>> await_resume()
+    {
+        std::vector<TaskResult<T>> all_results;
+        all_results.reserve(results.size());
+        for(auto& result : results) {
+            all_results.push_back(std::move(*result));
+        }
+        return all_results;
+    }
+private:
+    VoidTask run_task(std::size_t i)
+    {
+        auto result = co_await make_task(i);
+        results[i].emplace(to_task_result<T>(std::move(result)));
+        task_done();
+    }
+
+    F make_task;
+    std::vector<std::optional<TaskResult<T>>> results;
+};
+
+template<typename T>
+struct WhenAnyResult {
+    // Position (in the argument list) of the task that finished first
+    std::size_t index;
+    TaskResult<T> result;
+};
+
+/* Awaitable returned by when_any() */
+template<typename T, std::size_t N>
+class WhenAny : private TaskGroup {
+public:
+    WhenAny(gio::Cancellable* losers, std::array<Task<T>*, N> to_run)
+        : losers(losers), tasks(to_run) {}
+
+    constexpr bool await_ready() const noexcept { return N == 0; }
+
+    bool await_suspend(std::coroutine_handle<> awaiting)
+    {
+        begin(awaiting, N);
+        for(std::size_t i = 0; i < N; ++i) {
+            run_task(i).start();
+        }
+        return end_start();
+    }
+
+    WhenAnyResult<T> await_resume()
+    {
+        return std::move(*winner);
+    }
+private:
+    VoidTask run_task(std::size_t i)
+    {
+        Task<T>& task = *tasks[i];
+        auto result = co_await task;
+        if(!winner) {
+            winner.emplace(i, to_task_result<T>(std::move(result)));
+            if(losers) {
+                losers->cancel();
+            }
+        }
+        task_done();
+    }
+
+    gio::Cancellable* losers;
+    std::array<Task<T>*, N> tasks;
+    std::optional<WhenAnyResult<T>> winner;
+};
+
+/* Starts all of the tasks at once and resumes once every one of them has finished. Usage:
+
+       auto [a, b] = co_await when_all(get_a(cancellable), get_b(cancellable));
+*/
+template<typename ...Ts>
+WhenAll<Ts...> when_all(Task<Ts>&&... tasks)
+{
+    return WhenAll<Ts...>{tasks...};
+}
+
+/* Starts `count` tasks at once, where task i is created by calling make_task(i), and resumes once
+   every one of them has finished. Results are returned in the same order as the tasks */
+template<typename F>
+WhenAllRange<std::decay_t<F>> when_all(std::size_t count, F&& make_task)
+{
+    return WhenAllRange<std::decay_t<F>>{count, std::forward<F>(make_task)};
+}
+
+/* Starts all of the tasks at once and returns the outcome of whichever finishes first (successfully
+   or not). `losers` is then cancelled, so every task should have been created with it; it should not
+   be shared with anything else. Still waits for the cancelled tasks to wind down before resuming,
+   since their frames refer back to the awaitable */
+template<typename T, typename ...Rest>
+    requires (std::same_as<T, Rest> && ...)
+WhenAny<T, 1 + sizeof...(Rest)> when_any(gio::Cancellable* losers, Task<T>&& first, Task<Rest>&&... rest)
+{
+    return WhenAny<T, 1 + sizeof...(Rest)>{losers, {&first, &rest...}};
+}
+
+inline bool is_timeout_error(ErrorPtr& error)
+{
+    return error && error->domain == YOUTUBE_CHAT_ERROR && error->code == YOUTUBE_CHAT_ERROR_TIMED_OUT;
+}
+
+inline void cancel_linked_cancellable(GCancellable*, gpointer linked)
+{
+    g_cancellable_cancel(G_CANCELLABLE(linked));
+}
+
+/* Runs the task returned by make_task(linked), where `linked` is a new Cancellable that gets cancelled
+   once either `cancellable` is cancelled or `timeout_ms` milliseconds have passed. If the deadline is
+   what stopped the task, its error is replaced with a YOUTUBE_CHAT_ERROR_TIMED_OUT error. The timer
+   runs on the calling thread's main context. A timeout of 0 means no deadline. Usage:
+
+       auto error = co_await with_deadline(10000, cancellable, [&](gio::Cancellable* linked) {
+           return do_request(linked);
+       });
+*/
+template<typename F,
+         typename T = typename task_value<std::invoke_result_t<F&, gio::Cancellable*>>::type>
+Task<T> with_deadline(guint timeout_ms, gio::Cancellable* cancellable, F make_task)
+{
+    if(timeout_ms == 0) {
+        auto result = co_await make_task(cancellable);
+        co_return std::move(result);
+    }
+
+    auto linked = gio::Cancellable::create();
+    gio::Cancellable* linked_ptr = linked;
+    gulong parent_handler = 0;
+    if(cancellable) {
+        // Note: calls the handler immediately if `cancellable` is already cancelled
+        parent_handler = g_cancellable_connect(reinterpret_cast<GCancellable*>(cancellable),
+                                               G_CALLBACK(cancel_linked_cancellable),
+                                               reinterpret_cast<GCancellable*>(linked_ptr), nullptr);
+    }
+    bool timed_out = false;
+    auto deadline = timeout_add_once_local(timeout_ms, [&timed_out, linked_ptr] {
+        timed_out = true;
+        linked_ptr->cancel();
+    });
+
+    auto result = co_await make_task(linked_ptr);
+    deadline.disconnect();
+    if(parent_handler) {
+        g_cancellable_disconnect(reinterpret_cast<GCancellable*>(cancellable), parent_handler);
+    }
+    if(timed_out) {
+        // The operation may have completed anyway if it raced with the cancellation
+        ErrorPtr error(YOUTUBE_CHAT_ERROR, YOUTUBE_CHAT_ERROR_TIMED_OUT, "Timed out after %u ms", timeout_ms);
+        if constexpr(std::same_as<T, void>) {
+            if(result) {
+                co_return error;
+            }
+        } else {
+            if(!result.has_value()) {
+                co_return std::unexpected(std::move(error));
+            }
+        }
+    }
+    co_return std::move(result);
+}
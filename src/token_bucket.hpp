@@ -0,0 +1,74 @@
+/*
+BirdTube - YouTube live chat protocol plugin
+Copyright (C) 2026 Cole Blakley
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+#pragma once
+
+#include <algorithm>
+#include <glib.h>
+
+/* Rate limiter that allows bursts of up to `capacity` operations, with one more becoming available
+   every `refill_interval` microseconds. Times are in g_get_monotonic_time() units. Not thread-safe */
+class TokenBucket {
+public:
+    TokenBucket(guint capacity, gint64 refill_interval)
+        : refill_interval(refill_interval),
+          max_credit((gint64)capacity * refill_interval),
+          credit(max_credit),
+          last_refill(g_get_monotonic_time())
+    {}
+
+    // Milliseconds until an operation is allowed (0 if one is allowed now)
+    guint get_wait_time(gint64 now)
+    {
+        refill(now);
+        if(credit >= refill_interval) {
+            return 0;
+        }
+        // Round up, so that waiting this long is always enough
+        return (guint)((refill_interval - credit + 999) / 1000);
+    }
+
+    // Returns false (and takes nothing) if no operation is allowed yet
+    bool try_take(gint64 now)
+    {
+        refill(now);
+        if(credit < refill_interval) {
+            return false;
+        }
+        credit -= refill_interval;
+        return true;
+    }
+
+    // Empties the bucket, e.g. after being told to slow down
+    void drain(gint64 now)
+    {
+        refill(now);
+        credit = 0;
+    }
+private:
+    void refill(gint64 now)
+    {
+        credit = std::min(credit + std::max<gint64>(now - last_refill, 0), max_credit);
+        last_refill = now;
+    }
+
+    // Stored as microseconds' worth of refilling rather than a token count to avoid fractions
+    gint64 refill_interval;
+    gint64 max_credit;
+    gint64 credit;
+    gint64 last_refill;
+};
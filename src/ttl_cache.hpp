@@ -0,0 +1,79 @@
+/*
+BirdTube - YouTube live chat protocol plugin
+Copyright (C) 2026 Cole Blakley
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+#pragma once
+
+#include <cstddef>
+#include <functional>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <utility>
+#include <glib.h>
+#include "string_hash.hpp"
+
+/* String-to-string map whose entries expire `ttl` microseconds after being stored, for remembering
+   API lookups that are expensive to repeat but go stale (e.g. which video a channel is streaming).
+   Holds at most `capacity` entries. Times are in g_get_monotonic_time() units. Not thread-safe */
+class TtlCache {
+public:
+    TtlCache(gint64 ttl, std::size_t capacity)
+        : ttl(ttl), capacity(capacity)
+    {}
+
+    // Null if there is no entry for the key, or it has expired
+    const std::string* get(std::string_view key, gint64 now)
+    {
+        auto entry = entries.find(key);
+        if(entry == entries.end()) {
+            return nullptr;
+        }
+        if(entry->second.expires_at <= now) {
+            entries.erase(entry);
+            return nullptr;
+        }
+        return &entry->second.value;
+    }
+
+    void put(std::string key, std::string value, gint64 now)
+    {
+        if(entries.size() >= capacity && !entries.contains(key)) {
+            std::erase_if(entries, [now](const auto& entry) { return entry.second.expires_at <= now; });
+            if(entries.size() >= capacity) {
+                // Nothing has expired; any entry will do, since they are all cheap to look up again
+                entries.erase(entries.begin());
+            }
+        }
+        entries.insert_or_assign(std::move(key), Entry{std::move(value), now + ttl});
+    }
+
+    void remove(std::string_view key)
+    {
+        if(auto entry = entries.find(key); entry != entries.end()) {
+            entries.erase(entry);
+        }
+    }
+private:
+    struct Entry {
+        std::string value;
+        gint64 expires_at;
+    };
+
+    gint64 ttl;
+    std::size_t capacity;
+    std::unordered_map<std::string, Entry, StringHash, std::equal_to<>> entries;
+};
@@ -0,0 +1,48 @@
+/*
+BirdTube - YouTube live chat protocol plugin
+Copyright (C) 2026 Cole Blakley
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+#include "worker_thread.hpp"
+
+WorkerThread::WorkerThread(const char* name)
+    : context(g_main_context_new()), loop(g_main_loop_new(context, /*is_running=*/false))
+{
+    thread = g_thread_new(name, [](gpointer data) -> gpointer {
+        auto* self = static_cast<WorkerThread*>(data);
+        // Keep our own references in case the WorkerThread is destroyed from within this thread
+        GMainContext* context = g_main_context_ref(self->context);
+        GMainLoop* loop = g_main_loop_ref(self->loop);
+        g_main_context_push_thread_default(context);
+        g_main_loop_run(loop);
+        g_main_context_pop_thread_default(context);
+        g_main_loop_unref(loop);
+        g_main_context_unref(context);
+        return nullptr;
+    }, this);
+}
+
+WorkerThread::~WorkerThread() noexcept
+{
+    g_main_loop_quit(loop);
+    if(g_thread_self() == thread) {
+        // Can't join ourselves; the thread exits once the current callback returns
+        g_thread_unref(thread);
+    } else {
+        g_thread_join(thread);
+    }
+    g_main_loop_unref(loop);
+    g_main_context_unref(context);
+}
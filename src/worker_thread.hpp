@@ -0,0 +1,38 @@
+/*
+BirdTube - YouTube live chat protocol plugin
+Copyright (C) 2026 Cole Blakley
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program.  If not, see <https://www.gnu.org/licenses/>.
+*/
+#pragma once
+
+#include <glib.h>
+
+/* Thread that runs a main loop on its own GMainContext. The context is the thread-default context
+   within the thread, so async operations started there also complete there */
+class WorkerThread {
+public:
+    explicit
+    WorkerThread(const char* name);
+    WorkerThread(const WorkerThread&) = delete;
+    WorkerThread& operator=(const WorkerThread&) = delete;
+    // Stops the main loop. Any callbacks still pending on the context are dropped
+    ~WorkerThread() noexcept;
+
+    GMainContext* get_context() const { return context; }
+private:
+    GMainContext* context;
+    GMainLoop* loop;
+    GThread* thread;
+};
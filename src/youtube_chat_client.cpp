@@ -16,102 +16,453 @@ You should have received a copy of the GNU General Public License
 along with this program.  If not, see <https://www.gnu.org/licenses/>.
 */
 #include "youtube_chat_client.hpp"
+#include <algorithm>
+#include <array>
+#include <coroutine>
+#include <functional>
+#include <deque>
+#include <memory>
+#include <optional>
 #include <string>
-#include <map>
+#include <string_view>
+#include <unordered_map>
+#include <unordered_set>
+#include <atomic>
+#include <vector>
 #ifdef __linux__
 #include <sys/random.h>
 #endif
+#include <initializer_list>
+#include <utility>
+#include <libsoup/soup.h>
+#include <rest/rest.h>
 #include <peel/Rest/OAuth2Proxy.h>
-#include <peel/Rest/OAuth2ProxyCall.h>
 #include <peel/Rest/PkceCodeChallenge.h>
 #include <peel/Soup/Logger.h>
 #include <peel/Soup/LoggerLogLevel.h>
 #include <peel/Soup/MemoryUse.h>
+#include <peel/Soup/Message.h>
+#include <peel/Soup/MessageHeaders.h>
+#include <peel/Soup/Session.h>
 #include <peel/Soup/Status.h>
+#include <peel/GLib/Bytes.h>
 #include <peel/UniquePtr.h>
 #include <peel/ArrayRef.h>
 #include <peel/GLib/functions.h>
 #include <peel/GLib/HashTable.h>
 #include "task.hpp"
+#include "task_combinators.hpp"
 #include "youtube_chat_parser.hpp"
 #include "one_shot_server.hpp"
 #include "event_source_token.hpp"
 #include "error_wrapper.hpp"
+#include "main_context.hpp"
+#include "spsc_queue.hpp"
+#include "worker_thread.hpp"
+#include "live_chat_registry.hpp"
+#include "client_context.hpp"
+#include "token_bucket.hpp"
+#include "slot_map.hpp"
+#include "string_hash.hpp"
+#include "ttl_cache.hpp"
+#include "latency_histogram.hpp"
 
 G_DEFINE_QUARK(youtube-chat-error-quark, youtube_chat_error)
 
-/* Oauth2ProxyCall that serializes a JSON string and adds query parameter "part=snippet" */
-class JsonSnippetPoster final : public rest::OAuth2ProxyCall {
-    PEEL_SIMPLE_CLASS(JsonSnippetPoster, rest::OAuth2ProxyCall)
+namespace youtube {
+
+#define YOUTUBE_API_BASE_URL "https://www.googleapis.com/youtube/v3/"
+#define YOUTUBE_API_AUTH_URL "https://accounts.google.com/o/oauth2/v2/auth"
+#define YOUTUBE_API_TOKEN_URL "https://oauth2.googleapis.com/token"
+#define YOUTUBE_API_SCOPE "https://www.googleapis.com/auth/youtube.force-ssl"
+#define LOOPBACK_REDIRECT_URL "http://127.0.0.1:43215"
+#define REDIRECT_PORT 43215
+#define STATE_STR_LEN 16
+#define DEFAULT_POLL_INTERVAL 5000
+// How long to wait for the user to finish the OAuth flow in their browser
+#define AUTH_REDIRECT_TIMEOUT 600000
+// Bounds (in milliseconds) on how often an upcoming broadcast is checked for having gone live. The
+// interval shrinks from the max to the min as the scheduled start time approaches
+#define UPCOMING_MIN_POLL_INTERVAL 5000
+#define UPCOMING_MAX_POLL_INTERVAL 900000
+// Once a broadcast is past its scheduled start time, the interval grows back from the min with how
+// late it is, up to this many milliseconds
+#define UPCOMING_LATE_MAX_POLL_INTERVAL 120000
+// Stop waiting for a broadcast that is this many microseconds past its scheduled start time
+#define UPCOMING_MAX_LATENESS (6 * G_TIME_SPAN_HOUR)
+// Number of polls in a row without any messages before a chat is considered idle. Each further
+// empty poll stretches the interval by half, up to IDLE_MAX_POLL_INTERVAL milliseconds
+#define IDLE_POLLS_BEFORE_DECAY 3
+#define IDLE_MAX_POLL_INTERVAL 30000
+#define DEFAULT_BACKGROUND_POLL_MULTIPLIER 4
+// Posting limits for a single chat: bursts of up to SEND_BURST messages, then one message every
+// SEND_INTERVAL microseconds
+#define SEND_BURST 3
+#define SEND_INTERVAL (1500 * G_TIME_SPAN_MILLISECOND)
+// Times a message is retried after being rejected for posting too quickly, and the delay (in
+// milliseconds) before the first retry. The delay doubles with each retry
+#define MAX_SEND_RETRIES 4
+#define SEND_RETRY_DELAY 2000
+// Times a failed poll is retried before the failure is reported, and the delay (in milliseconds)
+// before the first retry. The delay doubles with each retry, up to POLL_RETRY_DELAY << MAX_POLL_RETRIES
+#define MAX_POLL_RETRIES 4
+#define POLL_RETRY_DELAY 2000
+// Moderation actions (shared by all of a client's chats) are sent at most MAX_MODERATION_REQUESTS at
+// a time, in bursts of up to MODERATION_BURST, then one every MODERATION_INTERVAL microseconds
+#define MAX_MODERATION_REQUESTS 4
+#define MODERATION_BURST 10
+#define MODERATION_INTERVAL (200 * G_TIME_SPAN_MILLISECOND)
+// Like MAX_SEND_RETRIES/SEND_RETRY_DELAY, but for moderation actions. The whole queue is held back
+// while waiting to retry
+#define MAX_MODERATION_RETRIES 4
+#define MODERATION_RETRY_DELAY 1000
+// How long (in microseconds) to remember which video a channel is streaming, and which channel a
+// handle belongs to. Looking up a channel's live stream is one of the API's most expensive calls
+#define LIVE_VIDEO_CACHE_TTL (5 * G_TIME_SPAN_MINUTE)
+#define CHANNEL_ID_CACHE_TTL (24 * G_TIME_SPAN_HOUR)
+#define RESOLVE_CACHE_CAPACITY 256
+// Milliseconds between each conversation's catch-up poll after connectivity returns
+#define CONVERSATION_RESYNC_STAGGER 250
+// Each new Date header sample moves the server clock offset estimate 1/N of the way towards it
+#define CLOCK_OFFSET_SMOOTHING 16
+
+// Indexed by Endpoint
+static constexpr guint DEFAULT_REQUEST_TIMEOUTS[ENDPOINT_COUNT] = {
+    10000, // Channels
+    10000, // Videos
+    15000, // LiveChatMessages
+    10000, // SendMessage
+    10000, // Moderation
+    10000, // Search
+    15000, // Token
+};
+
+// API quota units charged per request (an estimate, going by the published costs). Indexed by Endpoint
+static constexpr guint QUOTA_COSTS[ENDPOINT_COUNT] = {
+    1,   // Channels
+    1,   // Videos
+    5,   // LiveChatMessages
+    50,  // SendMessage
+    50,  // Moderation
+    100, // Search
+    0,   // Token
+};
+
+/* Counters behind ChatClient::get_metrics(). Updated on the client's context, read from any thread */
+struct MetricsCounters {
+    struct EndpointCounters {
+        std::atomic<guint64> requests = 0;
+        std::atomic<guint64> failures = 0;
+        std::atomic<guint64> bytes_sent = 0;
+        std::atomic<guint64> bytes_received = 0;
+        LatencyHistogram latency;
+    };
+
+    // Counts the failed request, unless it was only cancelled
+    void record_error(Endpoint endpoint, const ErrorPtr& error)
+    {
+        if(error->domain == G_IO_ERROR && error->code == G_IO_ERROR_CANCELLED) {
+            return;
+        }
+        auto error_class = ErrorClass::Network;
+        if(error->domain == YOUTUBE_CHAT_ERROR) {
+            switch(error->code) {
+            case YOUTUBE_CHAT_ERROR_TIMED_OUT: error_class = ErrorClass::Timeout; break;
+            case YOUTUBE_CHAT_ERROR_RATE_LIMITED: error_class = ErrorClass::RateLimited; break;
+            case YOUTUBE_CHAT_ERROR_CHAT_ENDED: error_class = ErrorClass::ChatEnded; break;
+            default: error_class = ErrorClass::Api;
+            }
+        }
+        endpoints[(std::size_t)endpoint].failures.fetch_add(1, std::memory_order_relaxed);
+        errors[(std::size_t)error_class].fetch_add(1, std::memory_order_relaxed);
+    }
+
+    std::array<EndpointCounters, ENDPOINT_COUNT> endpoints;
+    std::array<std::atomic<guint64>, ERROR_CLASS_COUNT> errors{};
+    std::atomic<guint64> batches_received = 0;
+    std::atomic<guint64> messages_received = 0;
+    LatencyHistogram parse_time;
+    LatencyHistogram receive_latency;
+    std::atomic<guint64> token_refreshes = 0;
+    std::atomic<guint64> token_refresh_failures = 0;
+};
+
+/* A conversation's membership in the LiveChatRegistry. Runs the callbacks on the client's context,
+   but only until the conversation is disconnected */
+class SharedChatMember final : public LiveChatSubscriber,
+                               public std::enable_shared_from_this<SharedChatMember> {
 public:
-    void init(Class*) {}
-    static peel::RefPtr<JsonSnippetPoster> create(peel::RefPtr<rest::OAuth2Proxy> proxy, peel::String json_str)
+    using BatchCallback = std::function<void(peel::RefPtr<MessageBatch>)>;
+    using PromotedCallback = std::function<void(guint poll_interval, peel::String next_page_token)>;
+    using PriorityCallback = std::function<void()>;
+
+    SharedChatMember(GMainContext* context, ChatPriority initial_priority, BatchCallback on_batch,
+                     PromotedCallback on_promoted, PriorityCallback on_priority_changed)
+        : context(g_main_context_ref(context)), batch_callback(std::move(on_batch)),
+          promoted_callback(std::move(on_promoted)), priority_callback(std::move(on_priority_changed)),
+          priority(initial_priority)
+    {}
+    SharedChatMember(const SharedChatMember&) = delete;
+    SharedChatMember& operator=(const SharedChatMember&) = delete;
+    ~SharedChatMember() noexcept
     {
-        // Have to copy proxy into a rest::Proxy object to avoid ambiguous call
-        auto obj = Object::create<JsonSnippetPoster>(prop_proxy(), peel::RefPtr<rest::Proxy>{proxy});
-        obj->set_method("POST");
-        obj->json_str = std::move(json_str);
-        // Have add Auth header here because it is normally done in proxy->new_call(), not
-        // in constructor of rest::OAuth2ProxyCall, so it is not an inherited behavior
-        auto auth_str = glib::strdup_printf("Bearer %s", proxy->get_access_token());
-        obj->add_header("Authorization", auth_str);
-        return obj;
-    }
-
-    bool vfunc_serialize_params(peel::String* content_type,
-                                peel::String* content, gsize* content_len,
-                                peel::UniquePtr<glib::Error>*)
+        g_main_context_unref(this->context);
+    }
+
+    void on_batch(peel::RefPtr<MessageBatch> batch) override
     {
-        content_type->set("application/json");
-        auto function = glib::strdup_printf("%s?part=snippet", this->get_function());
-        this->set_function(function);
-        *content = std::move(json_str);
-        *content_len = strlen(content->c_str());
-        return true;
+        post_to(this->context, [self = shared_from_this(), batch = std::move(batch)] {
+            if(self->is_active) {
+                self->batch_callback(batch);
+            }
+        });
+    }
+
+    void on_promoted(guint poll_interval, peel::String next_page_token) override
+    {
+        post_to(this->context, [self = shared_from_this(), poll_interval,
+                                next_page_token = std::move(next_page_token)]() mutable {
+            if(self->is_active) {
+                self->promoted_callback(poll_interval, std::move(next_page_token));
+            }
+        });
+    }
+
+    ChatPriority get_priority() const override { return this->priority.load(std::memory_order_relaxed); }
+
+    void on_priority_changed() override
+    {
+        post_to(this->context, [self = shared_from_this()] {
+            if(self->is_active) {
+                self->priority_callback();
+            }
+        });
     }
+
+    // Only call on the client's context
+    void deactivate() { this->is_active = false; }
+    void set_priority(ChatPriority new_priority) { this->priority.store(new_priority, std::memory_order_relaxed); }
 private:
-    peel::String json_str;
+    GMainContext* context;
+    BatchCallback batch_callback;
+    PromotedCallback promoted_callback;
+    PriorityCallback priority_callback;
+    // Only accessed on the client's context
+    bool is_active = true;
+    // The conversation's own priority. Read by the registry from any thread
+    std::atomic<ChatPriority> priority;
 };
 
-PEEL_CLASS_IMPL(JsonSnippetPoster, "JsonSnippetPoster", rest::OAuth2ProxyCall);
+/* The next poll of a conversation, while it waits for its interval to pass (or for polling to resume) */
+struct PendingPoll {
+    guint poll_interval;
+    peel::String next_page_token;
+};
 
-void JsonSnippetPoster::Class::init()
-{
-    override_vfunc_serialize_params<JsonSnippetPoster>();
-}
+/* A message waiting in a conversation's outbox. Shared between the outbox and the coroutine
+   waiting for it to be sent, since either may go away first */
+struct OutgoingMessage {
+    explicit
+    OutgoingMessage(const char* text, gio::Cancellable* cancellable)
+        : text(text), cancellable(cancellable) {}
+    ~OutgoingMessage() noexcept
+    {
+        if(waiter_context) {
+            g_main_context_unref(waiter_context);
+        }
+    }
 
-namespace youtube {
+    // Finishes the send with the given outcome, resuming whoever is waiting for it
+    void complete(ErrorPtr result)
+    {
+        this->error = std::move(result);
+        this->is_done = true;
+        if(this->waiter) {
+            // Deferred so that the sender never runs from inside the outbox's bookkeeping
+            post_to(this->waiter_context, [waiter = this->waiter] { waiter.resume(); });
+        }
+    }
 
-#define YOUTUBE_API_BASE_URL "https://www.googleapis.com/youtube/v3/"
-#define YOUTUBE_API_AUTH_URL "https://accounts.google.com/o/oauth2/v2/auth"
-#define YOUTUBE_API_TOKEN_URL "https://oauth2.googleapis.com/token"
-#define YOUTUBE_API_SCOPE "https://www.googleapis.com/auth/youtube.force-ssl"
-#define LOOPBACK_REDIRECT_URL "http://127.0.0.1:43215"
-#define REDIRECT_PORT 43215
-#define STATE_STR_LEN 16
+    std::string text;
+    peel::RefPtr<gio::Cancellable> cancellable;
+    guint attempts = 0;
+    ErrorPtr error;
+    bool is_done = false;
+    std::coroutine_handle<> waiter;
+    GMainContext* waiter_context = nullptr;
+};
+
+/* Awaitable that waits for an OutgoingMessage to be sent (or fail) */
+struct WaitForSend {
+    bool await_ready() const noexcept { return message->is_done; }
+    void await_suspend(std::coroutine_handle<> handle)
+    {
+        message->waiter = handle;
+        message->waiter_context = g_main_context_ref_thread_default();
+    }
+    ErrorPtr await_resume() { return message->error; }
+
+    std::shared_ptr<OutgoingMessage> message;
+};
+
+/* A moderation action that is queued or in flight. Shared by every caller that asked for the same
+   action, so that it is only sent once */
+struct ModerationRequest {
+    ModerationRequest(std::string key, ConversationId conversation, const char* live_chat_id,
+                      ModerationAction action, gio::Cancellable* cancellable)
+        : key(std::move(key)), conversation(conversation), live_chat_id(live_chat_id),
+          action(std::move(action)), cancellable(cancellable),
+          waiter_context(g_main_context_ref_thread_default())
+    {}
+    ModerationRequest(const ModerationRequest&) = delete;
+    ModerationRequest& operator=(const ModerationRequest&) = delete;
+    ~ModerationRequest() noexcept
+    {
+        g_main_context_unref(waiter_context);
+    }
+
+    void complete(ErrorPtr result)
+    {
+        this->error = std::move(result);
+        this->is_done = true;
+        for(auto waiter : this->waiters) {
+            post_to(this->waiter_context, [waiter] { waiter.resume(); });
+        }
+        this->waiters.clear();
+    }
+
+    std::string key;
+    ConversationId conversation;
+    std::string live_chat_id;
+    ModerationAction action;
+    // The conversation's fetch_cancel; cancelled if the conversation is disconnected
+    peel::RefPtr<gio::Cancellable> cancellable;
+    guint attempts = 0;
+    ErrorPtr error;
+    bool is_done = false;
+    std::vector<std::coroutine_handle<>> waiters;
+    GMainContext* waiter_context;
+};
+
+/* Awaitable that waits for a ModerationRequest to finish */
+struct WaitForModeration {
+    bool await_ready() const noexcept { return request->is_done; }
+    void await_suspend(std::coroutine_handle<> handle) { request->waiters.push_back(handle); }
+    ErrorPtr await_resume() { return request->error; }
+
+    std::shared_ptr<ModerationRequest> request;
+};
+
+/* Moderation actions waiting to be sent. Outlives the client if a request is still in flight when it
+   is destroyed, so that the request can tell not to touch the client */
+struct ModerationQueue {
+    // Removes the request from by_key, unless the queue has since been cleared and the same action
+    // queued again
+    void forget(const std::shared_ptr<ModerationRequest>& request)
+    {
+        auto queued = by_key.find(request->key);
+        if(queued != by_key.end() && queued->second == request) {
+            by_key.erase(queued);
+        }
+    }
+
+    // Fails every waiting and in-flight request; called when the client is destroyed
+    void close()
+    {
+        is_closed = true;
+        retry_source.disconnect();
+        auto outstanding = std::exchange(by_key, {});
+        waiting.clear();
+        for(auto& [key, request] : outstanding) {
+            request->complete(ErrorPtr(YOUTUBE_CHAT_ERROR, 1, "Client was destroyed before the action finished"));
+        }
+    }
+
+    std::deque<std::shared_ptr<ModerationRequest>> waiting;
+    // Waiting and in-flight requests, by ModerationRequest::key
+    std::unordered_map<std::string, std::shared_ptr<ModerationRequest>> by_key;
+    guint in_flight = 0;
+    TokenBucket limit{MODERATION_BURST, MODERATION_INTERVAL};
+    // Set while the queue is held back after being rate limited
+    EventSourceToken retry_source;
+    bool is_closed = false;
+};
+
+/* Awaitable that parks the awaiting coroutine in a list, to be resumed by whoever owns the list */
+struct WaitInList {
+    constexpr bool await_ready() const noexcept { return false; }
+    void await_suspend(std::coroutine_handle<> handle) { waiters.push_back(handle); }
+    constexpr void await_resume() const noexcept {}
+
+    std::vector<std::coroutine_handle<>>& waiters;
+};
 
 struct Conversation {
-    Conversation(StreamInfo stream_info)
-        : stream_info(std::move(stream_info)), fetch_cancel(gio::Cancellable::create())
+    Conversation(ConversationId id, std::string stream_url, StreamInfo stream_info)
+        : id(id), stream_url(std::move(stream_url)), stream_info(std::move(stream_info)),
+          fetch_cancel(gio::Cancellable::create())
     {}
     Conversation(const Conversation&) = delete;
-    Conversation(Conversation&&) noexcept = default;
     ~Conversation() noexcept
     {
         disconnect();
     }
     Conversation& operator=(const Conversation&) = delete;
-    Conversation& operator=(Conversation&&) noexcept = default;
 
     void disconnect()
     {
         this->fetch_messages_source.disconnect();
         this->fetch_cancel->cancel();
+        for(auto& subscriber : this->subscribers) {
+            subscriber.close();
+        }
+        this->subscribers.clear();
+        this->keep_warm.release();
+        for(auto& message : this->outbox) {
+            message->complete(ErrorPtr(YOUTUBE_CHAT_ERROR, 1, "Disconnected before the message was sent"));
+        }
+        this->outbox.clear();
+        if(this->shared_chat) {
+            this->shared_chat->deactivate();
+            LiveChatRegistry::get_default().leave(this->stream_info.live_chat_id.c_str(), this->shared_chat.get());
+            this->shared_chat = nullptr;
+        }
     }
 
+    ConversationId id;
+    std::string stream_url;
+    std::string video_id;
+    // Set if the stream URL was a channel's (rather than the video's), to the channel's ID
+    std::string channel_id;
     StreamInfo stream_info;
     peel::RefPtr<gio::Cancellable> fetch_cancel;
     EventSourceToken fetch_messages_source;
+    std::vector<AsyncStream<peel::RefPtr<MessageBatch>>> subscribers;
+    // Only polled by this client if it is the chat's fetcher
+    std::shared_ptr<SharedChatMember> shared_chat;
+    // Keeps the API connection open between polls, which may be far apart
+    ClientContext::KeepWarm keep_warm;
+    // Number of polls in a row that returned no messages
+    guint idle_polls = 0;
+    // Number of polls in a row that failed
+    guint poll_failures = 0;
+    // Set from when a poll is scheduled until it is sent
+    std::optional<PendingPoll> pending_poll;
+    ChatPriority priority = ChatPriority::Normal;
+    // What the chat was last polled at: the highest priority among all conversations sharing it
+    ChatPriority poll_priority = ChatPriority::Normal;
+    // Messages waiting to be posted, in order
+    std::deque<std::shared_ptr<OutgoingMessage>> outbox;
+    // Set while drain_outbox_async() is running
+    bool is_sending = false;
+    TokenBucket send_limit{SEND_BURST, SEND_INTERVAL};
+    // The poll request's URL. Everything up to poll_url_prefix_len (i.e. all but the page token)
+    // is built on the first poll and kept, so later polls only rewrite the page token in place
+    std::string poll_url;
+    std::size_t poll_url_prefix_len = 0;
+    // Moderation actions that have already taken effect, so are never sent again
+    std::unordered_set<std::string> banned_channels;
+    std::unordered_set<std::string> deleted_messages;
 };
 
 static
@@ -120,41 +471,383 @@ peel::String build_server_error_response(const char* error_str);
 static
 std::expected<peel::String, ErrorPtr> get_random_string();
 
+static
+peel::String build_api_url(const char* function, std::initializer_list<std::pair<const char*, const char*>> params);
+
+static
+void append_uri_escaped(std::string& out, const char* str);
+
+static
+peel::ArrayRef<const char> get_bytes_data(glib::Bytes*);
+
+static
+Task<peel::RefPtr<glib::Bytes>> send_and_read_async(soup::Message*, gio::Cancellable*);
+
+/* A batch of messages waiting to be handed from the worker thread to the UI thread */
+struct PendingBatch {
+    std::string stream_url;
+    peel::RefPtr<MessageBatch> batch;
+};
+
 PEEL_CLASS_IMPL(ChatClient, "YoutubeChatClient", gobject::Object)
 
 struct ChatClient::Impl {
-    using ConversationIterator = std::map<std::string, Conversation>::iterator;
+    ~Impl() noexcept
+    {
+        g_main_context_unref(this->ui_context);
+        g_string_free(this->send_buffer, true);
+        this->moderation->close();
+        this->is_alive->store(false, std::memory_order_relaxed);
+    }
 
-    // Operations
+    // Operations (these run on the client's context)
+    Task<void> authorize_async();
+    Task<ChannelIdentity> get_user_identity_async(gio::Cancellable*);
+    Task<void> connect_to_chat_async(std::string stream_url, gio::Cancellable*);
+    Task<void> send_message_async(std::string stream_url, const char* message, gio::Cancellable*);
+    // Posts the conversation's queued messages one at a time, in order, within its rate limit
+    Task<void> drain_outbox_async(ConversationId);
+    Task<void> moderate_async(std::string stream_url, ModerationAction, gio::Cancellable*);
+    // Sends as many queued moderation actions as the concurrency and rate limits allow
+    void pump_moderation_queue();
+    Task<void> send_moderation_async(std::shared_ptr<ModerationRequest>);
     void schedule_access_token_refresh();
     Task<void> refresh_access_token_async(gio::Cancellable*);
+    // Token requests without a deadline; use run_request() to call these
+    Task<void> fetch_access_token_async(const char* auth_code, gio::Cancellable*);
+    Task<void> refresh_tokens_async(gio::Cancellable*);
     Task<StreamInfo> get_live_stream_info_async(peel::String video_id, gio::Cancellable*);
+    // Finds the video that the URL refers to, looking up what the channel is streaming if it's a
+    // channel's URL. Also returns the channel's ID in that case
+    Task<std::pair<peel::String, std::string>> resolve_video_id_async(StreamUrlTarget, gio::Cancellable*);
     Task<void> fetch_messages_async(
-        ConversationIterator, guint poll_interval, peel::String next_page_token = nullptr);
+        ConversationId, guint poll_interval, peel::String next_page_token = nullptr);
+    void schedule_fetch(Conversation&, guint poll_interval, peel::String next_page_token);
+    ChatPriority get_poll_priority(const Conversation&) const;
+    // Polls right away if the chat's priority was raised to Foreground
+    void on_poll_priority_changed(Conversation&);
+    // Retries a failed poll after a backoff, or hands the chat over to another client (see the definition)
+    void retry_fetch(Conversation&, guint poll_interval, peel::String next_page_token, const ErrorPtr&);
+    // Sends the conversation's pending poll after `delay` milliseconds (or once its subscribers have
+    // room, if that's later)
+    void arm_pending_poll(Conversation&, guint delay);
+    void start_pending_poll(Conversation&);
+    void on_connectivity_changed(bool is_available, guint resync_delay);
+    // Catches up after connectivity returns: refreshes the access token if needed, then sends every
+    // waiting poll, a few at a time
+    Task<void> resync_async();
+    void deliver_batch(Conversation&, peel::RefPtr<MessageBatch>);
+    // Starts receiving the chat of a conversation whose broadcast is live
+    void start_chat(Conversation&);
+    void schedule_upcoming_check(Conversation&);
+    // Checks whether an upcoming broadcast has started, starting its chat if so and otherwise
+    // checking again later
+    Task<void> check_upcoming_async(ConversationId);
 
     bool is_access_expired() const;
+    // Runs the request task created by make_task(cancellable) under the endpoint's deadline
+    template<typename F,
+             typename T = typename task_value<std::invoke_result_t<F&, gio::Cancellable*>>::type>
+    Task<T> run_request(Endpoint, gio::Cancellable*, F make_task);
+    // Sends a YouTube API request (with a JSON body, if given) through the shared session and
+    // returns the response body
+    Task<peel::RefPtr<glib::Bytes>> send_api_request(
+        Endpoint, const char* method, const char* url, GBytes* json_body, gio::Cancellable*);
+    // "Bearer <access token>", rebuilt only when the access token changes
+    const char* get_authorization_header();
+    // Refines the estimate of the server's clock using the response's Date header
+    void update_clock_offset(soup::Message*, gint64 received_at);
+
+    // Threading
+    // Context that all network operations/parsing run on
+    GMainContext* get_context() const { return this->worker ? this->worker->get_context() : this->ui_context; }
+    ResumeOn enter_client_context() const { return ResumeOn{get_context()}; }
+    ResumeOn enter_ui_context() const { return ResumeOn{this->ui_context}; }
+    template<typename F>
+    auto run_sync(F&& callback);
+    template<typename F>
+    void run_on_ui(F&& callback);
+    void emit_error(ErrorPtr);
+    void emit_new_messages(const std::string& stream_url, peel::RefPtr<MessageBatch>);
+    // Disconnects the conversation, since its broadcast has ended
+    void end_chat(Conversation&);
+    // Null if the client isn't connected to the stream
+    Conversation* find_conversation(std::string_view stream_url);
+    // Disconnects the conversation and frees its slot
+    void remove_conversation(Conversation&);
+    void remove_all_conversations();
+    void dispatch_pending_batches();
 
     ChatClient* client;
+    // Only used for the OAuth flow and token refreshes; API requests go through the shared session
     peel::RefPtr<rest::OAuth2Proxy> proxy;
     peel::UniquePtr<rest::PkceCodeChallenge> pkce;
     peel::String state_str;
-    bool is_authorized;
-    EventSourceToken refresh_timer_source;
+    std::atomic<bool> is_authorized;
     peel::RefPtr<gio::Cancellable> refresh_cancel;
-    std::map<std::string, Conversation> conversations;
+    // Cleared once the Impl is destroyed. Held by callbacks that may be queued past that point
+    std::shared_ptr<std::atomic<bool>> is_alive = std::make_shared<std::atomic<bool>>(true);
+    SlotMap<Conversation, ConversationId> conversations;
+    // Index into `conversations` by stream URL
+    std::unordered_map<std::string, ConversationId, StringHash, std::equal_to<>> conversation_ids;
+    // Index into `conversations` by video ID. Several stream URLs can lead to the same video
+    std::unordered_multimap<std::string, ConversationId, StringHash, std::equal_to<>> video_conversation_ids;
+    // Channel IDs by handle
+    TtlCache channel_ids{CHANNEL_ID_CACHE_TTL, RESOLVE_CACHE_CAPACITY};
+    // Video IDs of live streams by channel ID
+    TtlCache live_videos{LIVE_VIDEO_CACHE_TTL, RESOLVE_CACHE_CAPACITY};
+    // Indexed by Endpoint. Set from the UI thread, read on the client's context
+    std::array<std::atomic<guint>, ENDPOINT_COUNT> request_timeouts;
+    std::array<std::atomic<guint64>, ENDPOINT_COUNT> timeout_counts{};
+    MetricsCounters metrics;
+    // Estimated server clock minus local clock, in microseconds. Written on the client's context
+    std::atomic<gint64> clock_offset = 0;
+    guint clock_offset_samples = 0;
+    // Emits metrics-updated on the UI thread
+    EventSourceToken metrics_source;
+    std::atomic<bool> watch_upcoming = true;
+    std::atomic<guint> background_poll_multiplier = DEFAULT_BACKGROUND_POLL_MULTIPLIER;
+    // Set while there is no connectivity; polls wait in their conversation's pending_poll until it returns
+    bool is_paused = false;
+    EventSourceToken resync_source;
+    // Reused for every request body that the client builds
+    GString* send_buffer = g_string_new(nullptr);
+    peel::String send_message_url;
+    peel::String ban_url;
+    std::shared_ptr<ModerationQueue> moderation = std::make_shared<ModerationQueue>();
+    peel::String authorization_header;
+    // The access token that authorization_header was built from
+    peel::String authorization_token;
+    // Coroutines waiting on the token refresh that is in progress
+    std::vector<std::coroutine_handle<>> refresh_waiters;
+    bool is_refreshing = false;
+    ErrorPtr last_refresh_error;
+    // Context of the thread that created the client; signals are always emitted here
+    GMainContext* ui_context;
+    // Only set if the client was created with use_worker_thread
+    std::unique_ptr<WorkerThread> worker;
+    // Batches received on the worker thread that have not been emitted yet
+    SpscQueue<PendingBatch> pending_batches;
 };
 
+template<typename F, typename T>
+Task<T> ChatClient::Impl::run_request(Endpoint endpoint, gio::Cancellable* cancellable, F make_task)
+{
+    auto index = (std::size_t)endpoint;
+    gint64 start_time = g_get_monotonic_time();
+    auto result = co_await with_deadline(this->request_timeouts[index].load(std::memory_order_relaxed),
+                                         cancellable, std::move(make_task));
+    auto& counters = this->metrics.endpoints[index];
+    counters.requests.fetch_add(1, std::memory_order_relaxed);
+    counters.latency.record(g_get_monotonic_time() - start_time);
+    ErrorPtr* error = nullptr;
+    if constexpr(std::same_as<T, void>) {
+        error = result ? &result : nullptr;
+    } else {
+        error = !result.has_value() ? &result.error() : nullptr;
+    }
+    if(error) {
+        this->metrics.record_error(endpoint, *error);
+        if(is_timeout_error(*error)) {
+            this->timeout_counts[index].fetch_add(1, std::memory_order_relaxed);
+        }
+    }
+    co_return std::move(result);
+}
+
+const char* ChatClient::Impl::get_authorization_header()
+{
+    const char* access_token = this->proxy->get_access_token();
+    if(!this->authorization_header || g_strcmp0(this->authorization_token.c_str(), access_token) != 0) {
+        this->authorization_token = access_token;
+        this->authorization_header = glib::strdup_printf("Bearer %s", access_token);
+    }
+    return this->authorization_header.c_str();
+}
+
+/* The Date header is truncated to the second, so a single sample is only good to within a second.
+   Averaging many of them evens out the rounding (and the jitter in network latency) */
+void ChatClient::Impl::update_clock_offset(soup::Message* message, gint64 received_at)
+{
+    const char* date_header = message->get_response_headers()->get_one("Date");
+    if(!date_header) {
+        return;
+    }
+    GDateTime* date = soup_date_time_new_from_http_string(date_header);
+    if(!date) {
+        return;
+    }
+    // On average, the server's clock was half a second past the truncated time
+    gint64 sample = g_date_time_to_unix(date) * G_USEC_PER_SEC + G_USEC_PER_SEC / 2 - received_at;
+    g_date_time_unref(date);
+    gint64 offset = this->clock_offset.load(std::memory_order_relaxed);
+    if(this->clock_offset_samples < CLOCK_OFFSET_SMOOTHING) {
+        // Plain average until there are enough samples, so the first one doesn't dominate
+        ++this->clock_offset_samples;
+        offset += (sample - offset) / (gint64)this->clock_offset_samples;
+    } else {
+        offset += (sample - offset) / CLOCK_OFFSET_SMOOTHING;
+    }
+    this->clock_offset.store(offset, std::memory_order_relaxed);
+}
+
+Task<peel::RefPtr<glib::Bytes>> ChatClient::Impl::send_api_request(
+    Endpoint endpoint, const char* method, const char* url, GBytes* json_body, gio::Cancellable* cancellable)
+{
+    auto message = soup::Message::create(method, url);
+    if(!message) {
+        co_return std::unexpected(ErrorPtr(YOUTUBE_CHAT_ERROR, 1, "Invalid request URL: %s", url));
+    }
+    message->get_request_headers()->append("Authorization", get_authorization_header());
+    if(json_body) {
+        soup_message_set_request_body_from_bytes(
+            reinterpret_cast<SoupMessage*>(static_cast<soup::Message*>(message)), "application/json", json_body);
+    }
+
+    auto& counters = this->metrics.endpoints[(std::size_t)endpoint];
+    if(json_body) {
+        counters.bytes_sent.fetch_add(g_bytes_get_size(json_body), std::memory_order_relaxed);
+    }
+    auto response = co_await run_request(endpoint, cancellable, [&message](gio::Cancellable* linked) {
+        return send_and_read_async(message, linked);
+    });
+    if(!response.has_value()) {
+        co_return std::move(response);
+    }
+    update_clock_offset(message, g_get_real_time());
+    counters.bytes_received.fetch_add(g_bytes_get_size(reinterpret_cast<GBytes*>(response->get())),
+                                      std::memory_order_relaxed);
+    auto status = (guint)message->get_status();
+    if(!SOUP_STATUS_IS_SUCCESSFUL(status)) {
+        auto reason = parse_error_reason(get_bytes_data(*response));
+        // An ended chat is reported as not found once it has been cleaned up
+        int code = YOUTUBE_CHAT_ERROR_FAILED;
+        if(g_strcmp0(reason.c_str(), "liveChatEnded") == 0 || g_strcmp0(reason.c_str(), "liveChatNotFound") == 0) {
+            code = YOUTUBE_CHAT_ERROR_CHAT_ENDED;
+        } else if(status == SOUP_STATUS_TOO_MANY_REQUESTS || g_strcmp0(reason.c_str(), "rateLimitExceeded") == 0
+                  || g_strcmp0(reason.c_str(), "userRateLimitExceeded") == 0) {
+            code = YOUTUBE_CHAT_ERROR_RATE_LIMITED;
+        } else if(status == SOUP_STATUS_UNAUTHORIZED) {
+            code = YOUTUBE_CHAT_ERROR_UNAUTHORIZED;
+        }
+        ErrorPtr error(YOUTUBE_CHAT_ERROR, code, "HTTP error %u (%s): %s", status,
+                       reason ? reason.c_str() : message->get_reason_phrase(), url);
+        this->metrics.record_error(endpoint, error);
+        co_return std::unexpected(std::move(error));
+    }
+    co_return std::move(response);
+}
+
+/* Runs the callback on the client's context, blocking until it finishes. Used by the synchronous
+   public methods, which are called from the UI thread */
+template<typename F>
+auto ChatClient::Impl::run_sync(F&& callback)
+{
+    if(!this->worker) {
+        return callback();
+    }
+    return invoke_on_sync(this->worker->get_context(), std::forward<F>(callback));
+}
+
+/* Runs the callback on the UI thread. Used for emitting signals from the client's context. Taking
+   a ref on the client here could race with it being finalized on the UI thread, so the callback is
+   dropped instead if the client is gone by the time it runs */
+template<typename F>
+void ChatClient::Impl::run_on_ui(F&& callback)
+{
+    if(!this->worker) {
+        callback();
+        return;
+    }
+    invoke_on(this->ui_context, [is_alive = this->is_alive, callback = std::forward<F>(callback)]() mutable {
+        if(is_alive->load(std::memory_order_relaxed)) {
+            callback();
+        }
+    });
+}
+
+void ChatClient::Impl::emit_error(ErrorPtr error)
+{
+    run_on_ui([client = this->client, error = std::move(error)]() mutable {
+        sig_error.emit(client, error.get());
+    });
+}
+
+void ChatClient::Impl::emit_new_messages(const std::string& stream_url, peel::RefPtr<MessageBatch> batch)
+{
+    if(!this->worker) {
+        sig_new_messages.emit(this->client, stream_url.c_str(), batch);
+        return;
+    }
+    // One wakeup of the UI thread per batch
+    this->pending_batches.push({stream_url, std::move(batch)});
+    invoke_on(this->ui_context, [is_alive = this->is_alive, client = this->client] {
+        if(is_alive->load(std::memory_order_relaxed)) {
+            client->m_impl->dispatch_pending_batches();
+        }
+    });
+}
+
+void ChatClient::Impl::end_chat(Conversation& conversation)
+{
+    g_message("Chat for %s has ended", conversation.stream_url.c_str());
+    if(!conversation.channel_id.empty()) {
+        // Whatever the channel streams next will be a different video
+        this->live_videos.remove(conversation.channel_id);
+    }
+    run_on_ui([client = this->client, stream_url = conversation.stream_url] {
+        sig_chat_ended.emit(client, stream_url.c_str());
+    });
+    remove_conversation(conversation);
+}
+
+Conversation* ChatClient::Impl::find_conversation(std::string_view stream_url)
+{
+    auto id = this->conversation_ids.find(stream_url);
+    return id != this->conversation_ids.end() ? this->conversations.get(id->second) : nullptr;
+}
+
+void ChatClient::Impl::remove_conversation(Conversation& conversation)
+{
+    this->conversation_ids.erase(conversation.stream_url);
+    auto [first, last] = this->video_conversation_ids.equal_range(conversation.video_id);
+    for(auto entry = first; entry != last; ++entry) {
+        if(entry->second == conversation.id) {
+            this->video_conversation_ids.erase(entry);
+            break;
+        }
+    }
+    this->conversations.erase(conversation.id);
+}
+
+void ChatClient::Impl::remove_all_conversations()
+{
+    this->conversation_ids.clear();
+    this->video_conversation_ids.clear();
+    this->conversations.clear();
+}
+
+void ChatClient::Impl::dispatch_pending_batches()
+{
+    while(auto pending = this->pending_batches.pop()) {
+        sig_new_messages.emit(this->client, pending->stream_url.c_str(), pending->batch);
+    }
+}
+
 void ChatClient::Class::init()
 {
     sig_new_messages = decltype(sig_new_messages)::create("new-messages");
     sig_error = decltype(sig_error)::create("error");
     sig_tokens_changed = decltype(sig_tokens_changed)::create("tokens-changed");
     sig_access_token_expiration_changed = decltype(sig_access_token_expiration_changed)::create("access-token-expiration-changed");
+    sig_chat_ended = decltype(sig_chat_ended)::create("chat-ended");
+    sig_metrics_updated = decltype(sig_metrics_updated)::create("metrics-updated");
 }
 
 void ChatClient::init(Class*)
 {
     m_impl = std::make_unique<Impl>(this);
+    m_impl->ui_context = g_main_context_ref_thread_default();
     m_impl->proxy = rest::OAuth2Proxy::create(
         YOUTUBE_API_AUTH_URL,
         YOUTUBE_API_TOKEN_URL,
@@ -163,6 +856,7 @@ void ChatClient::init(Class*)
         "",
         YOUTUBE_API_BASE_URL);
     #ifdef YOUTUBE_CHAT_CLIENT_LOGGING
+    // (The shared session for API requests has its own logger)
     auto logger = soup::Logger::create(soup::Logger::LogLevel::BODY);
     m_impl->proxy->add_soup_feature(logger);
     #endif
@@ -173,23 +867,36 @@ void ChatClient::init(Class*)
     m_impl->proxy->connect_notify(rest::OAuth2Proxy::prop_expiration_date(),
                                   this, &ChatClient::on_access_token_expiration_changed);
     m_impl->refresh_cancel = gio::Cancellable::create();
+    for(std::size_t i = 0; i < ENDPOINT_COUNT; ++i) {
+        m_impl->request_timeouts[i] = DEFAULT_REQUEST_TIMEOUTS[i];
+    }
 }
 
-peel::RefPtr<ChatClient> ChatClient::create(const char* client_id, const char* client_secret)
+peel::RefPtr<ChatClient> ChatClient::create(const char* client_id, const char* client_secret,
+                                            bool use_worker_thread)
 {
     auto client = Object::create<ChatClient>();
     // TODO: make these constructor properties
     client->m_impl->proxy->set_client_id(client_id);
     client->m_impl->proxy->set_client_secret(client_secret);
+    if(use_worker_thread) {
+        client->m_impl->worker = std::make_unique<WorkerThread>("youtube-chat-client");
+    }
+    auto* impl = client->m_impl.get();
+    ClientContext::get_default().add_connectivity_listener(impl, impl->get_context(),
+        [impl](bool is_available, guint resync_delay) {
+            impl->on_connectivity_changed(is_available, resync_delay);
+        });
 
     return client;
 }
 
 peel::RefPtr<ChatClient> ChatClient::create_authorized(const char* client_id, const char* client_secret,
                                                        const char* access_token, const char* refresh_token,
-                                                       peel::RefPtr<glib::DateTime> access_token_expiration)
+                                                       peel::RefPtr<glib::DateTime> access_token_expiration,
+                                                       bool use_worker_thread)
 {
-    auto client = create(client_id, client_secret);
+    auto client = create(client_id, client_secret, use_worker_thread);
     client->m_impl->is_authorized = true;
     client->m_impl->proxy->set_access_token(access_token);
     client->m_impl->proxy->set_refresh_token(refresh_token);
@@ -197,9 +904,19 @@ peel::RefPtr<ChatClient> ChatClient::create_authorized(const char* client_id, co
     return client;
 }
 
+void ChatClient::preconnect()
+{
+    // Only the API host: token requests go through each client's OAuth2Proxy, whose session librest
+    // doesn't expose, so a connection warmed up here would never be used for them
+    ClientContext::get_default().preconnect(YOUTUBE_API_BASE_URL);
+}
+
 ChatClient::~ChatClient() noexcept
 {
+    ClientContext::get_default().remove_connectivity_listener(m_impl.get());
     disconnect();
+    // Stop the worker before tearing down anything it might be using
+    m_impl->worker = nullptr;
 }
 
 bool ChatClient::is_authorized() const
@@ -209,49 +926,177 @@ bool ChatClient::is_authorized() const
 
 bool ChatClient::is_chat_connected(const char* stream_url) const
 {
-    return m_impl->conversations.find(stream_url) != m_impl->conversations.end();
+    return m_impl->run_sync([&] {
+        return m_impl->find_conversation(stream_url) != nullptr;
+    });
 }
 
-const char* ChatClient::get_title(const char* stream_url) const
+peel::String ChatClient::get_title(const char* stream_url) const
 {
-    auto conversation = m_impl->conversations.find(stream_url);
-    if(conversation == m_impl->conversations.end()) {
-        g_warning("Unknown conversation: %s", stream_url);
-        return "";
-    }
-    return conversation->second.stream_info.title;
+    // Copied on the client's context, which may replace (or free) the stream info at any time after
+    return m_impl->run_sync([&]() -> peel::String {
+        auto* conversation = m_impl->find_conversation(stream_url);
+        if(!conversation) {
+            g_warning("Unknown conversation: %s", stream_url);
+            return "";
+        }
+        return conversation->stream_info.title.c_str();
+    });
 }
 
 peel::String ChatClient::get_access_token() const
 {
-    return m_impl->proxy->get_access_token();
+    return m_impl->run_sync([&]() -> peel::String { return m_impl->proxy->get_access_token(); });
 }
 
 peel::String ChatClient::get_refresh_token() const
 {
-    return m_impl->proxy->get_refresh_token();
+    return m_impl->run_sync([&]() -> peel::String { return m_impl->proxy->get_refresh_token(); });
 }
 
 peel::RefPtr<glib::DateTime> ChatClient::get_access_token_expiration() const
 {
-    return m_impl->proxy->get_expiration_date();
+    return m_impl->run_sync([&]() -> peel::RefPtr<glib::DateTime> { return m_impl->proxy->get_expiration_date(); });
+}
+
+void ChatClient::set_request_timeout(Endpoint endpoint, guint timeout_ms)
+{
+    m_impl->request_timeouts[(std::size_t)endpoint].store(timeout_ms, std::memory_order_relaxed);
+}
+
+guint ChatClient::get_request_timeout(Endpoint endpoint) const
+{
+    return m_impl->request_timeouts[(std::size_t)endpoint].load(std::memory_order_relaxed);
+}
+
+void ChatClient::set_chat_priority(const char* stream_url, ChatPriority priority)
+{
+    m_impl->run_sync([&] {
+        auto* conversation = m_impl->find_conversation(stream_url);
+        if(!conversation) {
+            g_warning("Unknown conversation: %s", stream_url);
+            return;
+        }
+        conversation->priority = priority;
+        if(!conversation->shared_chat) {
+            m_impl->on_poll_priority_changed(*conversation);
+            return;
+        }
+        // The chat is polled by its fetcher (which may belong to another client), so let it know
+        conversation->shared_chat->set_priority(priority);
+        LiveChatRegistry::get_default().update_priority(conversation->stream_info.live_chat_id.c_str());
+    });
+}
+
+ChatPriority ChatClient::get_chat_priority(const char* stream_url) const
+{
+    return m_impl->run_sync([&] {
+        auto* conversation = m_impl->find_conversation(stream_url);
+        return conversation ? conversation->priority : ChatPriority::Normal;
+    });
+}
+
+void ChatClient::set_background_poll_multiplier(guint multiplier)
+{
+    m_impl->background_poll_multiplier.store(std::max(multiplier, 1u), std::memory_order_relaxed);
+}
+
+ClientMetrics ChatClient::get_metrics() const
+{
+    const auto& counters = m_impl->metrics;
+    ClientMetrics metrics;
+    metrics.timestamp = g_get_monotonic_time();
+    for(std::size_t i = 0; i < ENDPOINT_COUNT; ++i) {
+        auto& endpoint = metrics.endpoints[i];
+        endpoint.requests = counters.endpoints[i].requests.load(std::memory_order_relaxed);
+        endpoint.failures = counters.endpoints[i].failures.load(std::memory_order_relaxed);
+        endpoint.timeouts = m_impl->timeout_counts[i].load(std::memory_order_relaxed);
+        endpoint.bytes_sent = counters.endpoints[i].bytes_sent.load(std::memory_order_relaxed);
+        endpoint.bytes_received = counters.endpoints[i].bytes_received.load(std::memory_order_relaxed);
+        endpoint.quota_units = endpoint.requests * QUOTA_COSTS[i];
+        endpoint.latency = counters.endpoints[i].latency.snapshot();
+    }
+    for(std::size_t i = 0; i < ERROR_CLASS_COUNT; ++i) {
+        metrics.errors[i] = counters.errors[i].load(std::memory_order_relaxed);
+    }
+    metrics.batches_received = counters.batches_received.load(std::memory_order_relaxed);
+    metrics.messages_received = counters.messages_received.load(std::memory_order_relaxed);
+    metrics.parse_time = counters.parse_time.snapshot();
+    metrics.receive_latency = counters.receive_latency.snapshot();
+    metrics.clock_offset = m_impl->clock_offset.load(std::memory_order_relaxed);
+    metrics.token_refreshes = counters.token_refreshes.load(std::memory_order_relaxed);
+    metrics.token_refresh_failures = counters.token_refresh_failures.load(std::memory_order_relaxed);
+    metrics.warmup = ClientContext::get_default().get_warmup_stats();
+    // Unlike the counters, the conversations can only be looked at from the client's context
+    m_impl->run_sync([&] {
+        metrics.conversations.reserve(m_impl->conversations.size());
+        m_impl->conversations.for_each([&](Conversation& conversation) {
+            std::size_t buffered_batches = 0;
+            for(auto& subscriber : conversation.subscribers) {
+                buffered_batches += subscriber.get_buffered_count();
+            }
+            metrics.conversations.push_back(ConversationMetrics{
+                conversation.stream_url, conversation.priority, buffered_batches,
+                conversation.outbox.size(), conversation.idle_polls});
+        });
+    });
+    return metrics;
+}
+
+void ChatClient::set_metrics_interval(guint interval_ms)
+{
+    m_impl->metrics_source.disconnect();
+    if(interval_ms == 0) {
+        return;
+    }
+    GSource* source = g_timeout_source_new(interval_ms);
+    g_source_set_callback(source, [](gpointer data) -> gboolean {
+        sig_metrics_updated.emit(static_cast<ChatClient*>(data));
+        return G_SOURCE_CONTINUE;
+    }, this, nullptr);
+    m_impl->metrics_source = EventSourceToken{g_source_attach(source, m_impl->ui_context), m_impl->ui_context};
+    g_source_unref(source);
+}
+
+void ChatClient::set_watch_upcoming(bool enabled)
+{
+    m_impl->watch_upcoming.store(enabled, std::memory_order_relaxed);
+}
+
+bool ChatClient::is_chat_upcoming(const char* stream_url) const
+{
+    return m_impl->run_sync([&] {
+        auto* conversation = m_impl->find_conversation(stream_url);
+        return conversation && !conversation->stream_info.live_chat_id;
+    });
+}
+
+guint64 ChatClient::get_timeout_count(Endpoint endpoint) const
+{
+    return m_impl->timeout_counts[(std::size_t)endpoint].load(std::memory_order_relaxed);
 }
 
+// Note: called on the client's context, since that is where the proxy's tokens are updated
 void ChatClient::on_tokens_changed(gobject::Object*, gobject::ParamSpec*)
 {
-    auto access_token = get_access_token();
-    auto refresh_token = get_refresh_token();
+    peel::String access_token = m_impl->proxy->get_access_token();
+    peel::String refresh_token = m_impl->proxy->get_refresh_token();
     // May receive notifications for a token before the other is set; wait until they are both set
     // to non-null values before doing anything
     if(access_token && refresh_token) {
-        sig_tokens_changed.emit(this, access_token, refresh_token);
+        m_impl->run_on_ui([this, access_token = std::move(access_token), refresh_token = std::move(refresh_token)] {
+            sig_tokens_changed.emit(this, access_token, refresh_token);
+        });
     }
 }
 
+// Note: called on the client's context, since that is where the proxy's tokens are updated
 void ChatClient::on_access_token_expiration_changed(gobject::Object*, gobject::ParamSpec*)
 {
-    auto expiration = get_access_token_expiration();
-    sig_access_token_expiration_changed.emit(this, expiration);
+    peel::RefPtr<glib::DateTime> expiration = m_impl->proxy->get_expiration_date();
+    m_impl->run_on_ui([this, expiration = std::move(expiration)] {
+        sig_access_token_expiration_changed.emit(this, expiration);
+    });
 }
 
 std::expected<peel::String, ErrorPtr> ChatClient::generate_auth_url()
@@ -277,6 +1122,14 @@ std::expected<peel::String, ErrorPtr> ChatClient::generate_auth_url()
 }
 
 Task<void> ChatClient::authorize()
+{
+    co_await m_impl->enter_client_context();
+    auto error = co_await m_impl->authorize_async();
+    co_await m_impl->enter_ui_context();
+    co_return error;
+}
+
+Task<void> ChatClient::Impl::authorize_async()
 {
     static const uint8_t success_response[] =
         "<!DOCTYPE html>"
@@ -289,50 +1142,49 @@ Task<void> ChatClient::authorize()
           "</body>"
         "</html>";
 
-    if(!m_impl->pkce || !m_impl->state_str) {
+    if(!this->pkce || !this->state_str) {
         co_return ErrorPtr(YOUTUBE_CHAT_ERROR, 1, "No OAuth flow in-progress - call generate_auth_url first");
     }
 
     // First, wait for the server's message and determine if we are authorized
     auto auth_listener = OneShotServer::create();
-    auto auth_response = co_await auth_listener->listen(REDIRECT_PORT);
+    auto auth_response = co_await auth_listener->listen(REDIRECT_PORT, AUTH_REDIRECT_TIMEOUT);
     if(!auth_response.has_value()) {
-        m_impl->pkce = nullptr;
-        m_impl->state_str = nullptr;
+        this->pkce = nullptr;
+        this->state_str = nullptr;
         co_return std::move(auth_response.error());
     }
     auto* error_str = (const char*)glib::HashTable::lookup(*auth_response, "error");
     if(error_str) {
         ErrorPtr error(YOUTUBE_CHAT_ERROR, 1, "OAuth redirect error: %s", error_str);
         co_await auth_listener->respond(soup::Status::FORBIDDEN, build_server_error_response(error->message));
-        m_impl->pkce = nullptr;
-        m_impl->state_str = nullptr;
+        this->pkce = nullptr;
+        this->state_str = nullptr;
         co_return error;
     }
     auto* auth_code = (const char*)glib::HashTable::lookup(*auth_response, "code");
     if(!auth_code) {
         ErrorPtr error(YOUTUBE_CHAT_ERROR, 1, "OAuth redirect error: Missing auth code");
         co_await auth_listener->respond(soup::Status::FORBIDDEN, build_server_error_response(error->message));
-        m_impl->pkce = nullptr;
-        m_impl->state_str = nullptr;
+        this->pkce = nullptr;
+        this->state_str = nullptr;
         co_return error;
     }
     auto* received_state_str = (const char*)glib::HashTable::lookup(*auth_response, "state");
-    auto expected_state_str = std::move(m_impl->state_str);
+    auto expected_state_str = std::move(this->state_str);
     if(!received_state_str || strcmp(received_state_str, expected_state_str) != 0) {
         ErrorPtr error(YOUTUBE_CHAT_ERROR, 1, "OAuth redirect error: Missing/incorrect state string");
         co_await auth_listener->respond(soup::Status::FORBIDDEN, build_server_error_response(error->message));
-        m_impl->pkce = nullptr;
+        this->pkce = nullptr;
         co_return error;
     }
 
     // Attempt to get the access token using the authorization code provided by the server
     {
-        AsyncResult result;
-        peel::UniquePtr<glib::Error> error;
-        m_impl->proxy->fetch_access_token_async(auth_code, m_impl->pkce->get_verifier(), nullptr, result.callback());
-        m_impl->proxy->fetch_access_token_finish(co_await result, &error);
-        m_impl->pkce = nullptr;
+        auto error = co_await run_request(Endpoint::Token, nullptr, [&](gio::Cancellable* cancellable) {
+            return fetch_access_token_async(auth_code, cancellable);
+        });
+        this->pkce = nullptr;
         if(error) {
             // TODO: map GError to HTTP error code
             co_await auth_listener->respond(soup::Status::FORBIDDEN, build_server_error_response(error->message));
@@ -342,13 +1194,13 @@ Task<void> ChatClient::authorize()
 
     // From this point forwards, OAuth2Proxy will add the access token as an
     // 'Authorization: Bearer <access_token>' header to each request
-    m_impl->is_authorized = true;
+    this->is_authorized = true;
     // Send the user's web browser a message letting them know authorization was successful
     auto error = co_await auth_listener->respond(soup::Status::OK, soup::MemoryUse::STATIC, success_response);
     if(error) {
         co_return error;
     }
-    m_impl->schedule_access_token_refresh();
+    this->schedule_access_token_refresh();
 
     // TODO: seems like librest is treating some error responses as success. If we send an empty client
     //  secret, everything appears to succeed but the Bearer token is '(null)', causing API calls to fail
@@ -358,28 +1210,56 @@ Task<void> ChatClient::authorize()
 void ChatClient::Impl::schedule_access_token_refresh()
 {
     auto expiration = this->proxy->get_expiration_date();
-    auto now = glib::DateTime::create_now_utc();
-    // Refresh 2 minutes before the expiration date
-    int64_t refresh_interval = expiration->difference(now) - 120000;
-    if(refresh_interval <= 0) {
-        this->refresh_access_token_async(this->refresh_cancel).start();
-    } else {
-        this->refresh_timer_source = glib::timeout_add_once((unsigned)refresh_interval, [this] {
+    // Refresh 2 minutes before the expiration date. The refresh timer is shared with all other
+    // clients, which keeps accounts with similar expiration dates from refreshing all at once
+    gint64 due_time = expiration->to_unix() * G_USEC_PER_SEC - 120 * G_USEC_PER_SEC;
+    ClientContext::get_default().schedule_refresh(this, due_time, get_context(), [this, is_alive = this->is_alive] {
+        // Runs on the client's context. May arrive just after disconnect(), or even after the client
+        // is destroyed: cancel_refresh() can't recall a refresh that has already been dispatched
+        if(is_alive->load(std::memory_order_relaxed) && this->is_authorized) {
             this->refresh_access_token_async(this->refresh_cancel).start();
-        });
-    }
+        }
+    });
+}
+
+/* True if a failed token refresh was turned down by the server (e.g. because the refresh token was
+   revoked), as opposed to not reaching it. Only the statuses the token endpoint uses for bad grants
+   count; server errors and anything that never got a response are worth retrying later */
+static
+bool is_refresh_rejected(const ErrorPtr& error)
+{
+    // librest reports HTTP errors by their status code
+    return error->domain == REST_PROXY_ERROR
+        && (error->code == REST_PROXY_ERROR_HTTP_BAD_REQUEST || error->code == REST_PROXY_ERROR_HTTP_UNAUTHORIZED);
 }
 
 Task<void> ChatClient::Impl::refresh_access_token_async(gio::Cancellable* cancellable)
 {
     g_assert(this->is_authorized);
+    if(this->is_refreshing) {
+        // Only one refresh at a time (e.g. when many polls find the token expired at once after a
+        // wakeup); the rest share its outcome
+        co_await WaitInList{this->refresh_waiters};
+        co_return this->last_refresh_error;
+    }
 
-    this->refresh_timer_source.disconnect();
+    this->is_refreshing = true;
+    ClientContext::get_default().cancel_refresh(this);
 
-    AsyncResult result;
-    peel::UniquePtr<glib::Error> error;
-    this->proxy->refresh_access_token_async(cancellable, result.callback());
-    this->proxy->refresh_access_token_finish(co_await result, &error);
+    auto error = co_await run_request(Endpoint::Token, cancellable, [this](gio::Cancellable* linked) {
+        return refresh_tokens_async(linked);
+    });
+    this->is_refreshing = false;
+    if(error && is_refresh_rejected(error)) {
+        error = ErrorPtr(YOUTUBE_CHAT_ERROR, YOUTUBE_CHAT_ERROR_UNAUTHORIZED,
+                         "Failed to refresh the access token: %s", error->message);
+    }
+    this->last_refresh_error = error;
+    auto& refresh_count = error ? this->metrics.token_refresh_failures : this->metrics.token_refreshes;
+    refresh_count.fetch_add(1, std::memory_order_relaxed);
+    for(auto waiter : std::exchange(this->refresh_waiters, {})) {
+        waiter.resume();
+    }
     if(error) {
         co_return error;
     }
@@ -394,37 +1274,52 @@ Task<void> ChatClient::Impl::refresh_access_token_async(gio::Cancellable* cancel
     co_return error;
 }
 
-Task<peel::String> ChatClient::get_user_display_name(gio::Cancellable* cancellable)
+Task<void> ChatClient::Impl::fetch_access_token_async(const char* auth_code, gio::Cancellable* cancellable)
 {
-    g_assert(m_impl->is_authorized);
-    if(m_impl->is_access_expired()) {
-        // Note: use passed in cancellable instead of m_impl->cancellable since this is a one-off
-        //   operation and not a periodic operation
-        auto error = co_await m_impl->refresh_access_token_async(cancellable);
-        if(error) {
-            co_return std::unexpected(std::move(error));
-        }
-    }
-
-    auto call = m_impl->proxy->new_call();
-    call->set_function("channels");
-    call->add_param("part", "snippet");
-    call->add_param("mine", "true");
-    call->add_param("maxResults", "1");
+    AsyncResult result;
+    peel::UniquePtr<glib::Error> error;
+    this->proxy->fetch_access_token_async(auth_code, this->pkce->get_verifier(), cancellable, result.callback());
+    this->proxy->fetch_access_token_finish(co_await result, &error);
+    co_return error;
+}
 
+Task<void> ChatClient::Impl::refresh_tokens_async(gio::Cancellable* cancellable)
+{
     AsyncResult result;
     peel::UniquePtr<glib::Error> error;
-    // Note: use passed in cancellable instead of m_impl->cancellable since this is a one-off
-    //   operation and not a periodic operation
-    call->invoke_async(cancellable, result.callback());
-    call->invoke_finish(co_await result, &error);
-    if(error) {
-        co_return std::unexpected(std::move(error));
+    this->proxy->refresh_access_token_async(cancellable, result.callback());
+    this->proxy->refresh_access_token_finish(co_await result, &error);
+    co_return error;
+}
+
+Task<ChannelIdentity> ChatClient::get_user_identity(gio::Cancellable* cancellable)
+{
+    co_await m_impl->enter_client_context();
+    auto identity = co_await m_impl->get_user_identity_async(cancellable);
+    co_await m_impl->enter_ui_context();
+    co_return identity;
+}
+
+Task<ChannelIdentity> ChatClient::Impl::get_user_identity_async(gio::Cancellable* cancellable)
+{
+    g_assert(this->is_authorized);
+    if(this->is_access_expired()) {
+        // Note: use passed in cancellable instead of this->cancellable since this is a one-off
+        //   operation and not a periodic operation
+        auto error = co_await this->refresh_access_token_async(cancellable);
+        if(error) {
+            co_return std::unexpected(std::move(error));
+        }
     }
 
-    const char* response = call->get_payload();
-    auto response_len = call->get_payload_length();
-    co_return parse_display_name(peel::ArrayRef{response, (guint)response_len});
+    auto url = build_api_url("channels", {{"part", "snippet"}, {"mine", "true"}, {"maxResults", "1"}});
+    // Note: use passed in cancellable instead of this->cancellable since this is a one-off
+    //   operation and not a periodic operation
+    auto response = co_await send_api_request(Endpoint::Channels, "GET", url, nullptr, cancellable);
+    if(!response.has_value()) {
+        co_return std::unexpected(std::move(response.error()));
+    }
+    co_return parse_channel_identity(get_bytes_data(*response));
 }
 
 // TODO: check where stream_url needs to persist across suspension points - save it into an owning
@@ -432,55 +1327,248 @@ Task<peel::String> ChatClient::get_user_display_name(gio::Cancellable* cancellab
 //  copies)
 Task<void> ChatClient::connect_to_chat_async(std::string stream_url, gio::Cancellable* cancellable)
 {
-    g_assert(m_impl->is_authorized);
-    if(m_impl->is_access_expired()) {
-        // Note: use passed in cancellable instead of m_impl->cancellable since this is a one-off
+    co_await m_impl->enter_client_context();
+    auto error = co_await m_impl->connect_to_chat_async(std::move(stream_url), cancellable);
+    co_await m_impl->enter_ui_context();
+    co_return error;
+}
+
+Task<void> ChatClient::Impl::connect_to_chat_async(std::string stream_url, gio::Cancellable* cancellable)
+{
+    g_assert(this->is_authorized);
+    // Get the connection for the videos call ready while the token is (possibly) refreshed
+    ClientContext::get_default().preconnect(YOUTUBE_API_BASE_URL);
+    if(this->is_access_expired()) {
+        // Note: use passed in cancellable instead of this->cancellable since this is a one-off
         //   operation and not a periodic operation
-        auto error = co_await m_impl->refresh_access_token_async(cancellable);
+        auto error = co_await this->refresh_access_token_async(cancellable);
         if(error) {
             co_return error;
         }
     }
 
-    if(auto conversation = m_impl->conversations.find(stream_url);
-       conversation != m_impl->conversations.end()) {
+    if(find_conversation(stream_url)) {
         g_warning("Already connected to: %s", stream_url.c_str());
         co_return {};
     }
 
-    auto video_id = extract_video_id(stream_url.c_str());
-    if(!video_id.has_value()) {
-        co_return std::move(video_id.error());
+    auto target = parse_stream_url(stream_url);
+    if(!target.has_value()) {
+        co_return std::move(target.error());
     }
-    // Note: use passed in cancellable instead of m_impl->cancellable since this is a one-off
+    // Note: use passed in cancellable instead of this->cancellable since this is a one-off
     //   operation and not a periodic operation
-    auto live_stream_info = co_await m_impl->get_live_stream_info_async(std::move(*video_id), cancellable);
-    if(!live_stream_info.has_value()) {
-        co_return std::move(live_stream_info.error());
+    auto resolved = co_await this->resolve_video_id_async(*target, cancellable);
+    if(!resolved.has_value()) {
+        co_return std::move(resolved.error());
+    }
+    auto& [video_id, channel_id] = *resolved;
+    // The same stream may already be joined through another spelling of its URL, in which case
+    // there's no need to look it up again. Its chat will then be shared through the LiveChatRegistry
+    std::expected<StreamInfo, ErrorPtr> live_stream_info;
+    Conversation* same_video = nullptr;
+    auto [first, last] = this->video_conversation_ids.equal_range(std::string_view{video_id.c_str()});
+    for(auto entry = first; entry != last && !same_video; ++entry) {
+        auto* other = this->conversations.get(entry->second);
+        if(other && other->stream_info.live_chat_id) {
+            same_video = other;
+        }
+    }
+    if(same_video) {
+        const StreamInfo& other_info = same_video->stream_info;
+        live_stream_info = StreamInfo{other_info.title.c_str(), other_info.live_chat_id.c_str(),
+                                      other_info.scheduled_start_time};
+    } else {
+        live_stream_info = co_await this->get_live_stream_info_async(video_id.c_str(), cancellable);
+        if(!live_stream_info.has_value()) {
+            auto& error = live_stream_info.error();
+            if(!channel_id.empty() && error->domain == YOUTUBE_CHAT_ERROR
+               && error->code == YOUTUBE_CHAT_ERROR_CHAT_ENDED) {
+                // The cached live video for the channel is out of date
+                this->live_videos.remove(channel_id);
+            }
+            co_return std::move(error);
+        }
+    }
+    bool is_upcoming = !live_stream_info->live_chat_id;
+    if(is_upcoming && !this->watch_upcoming.load(std::memory_order_relaxed)) {
+        co_return ErrorPtr(YOUTUBE_CHAT_ERROR, 1, "Stream has not started yet");
+    }
+    // Another connect call for the same stream may have finished while this one was waiting
+    if(find_conversation(stream_url)) {
+        co_return {};
     }
     // Add the conversation to the set of active converations
-    auto[conversation, _] = m_impl->conversations.emplace(std::move(stream_url), std::move(*live_stream_info));
-    m_impl->fetch_messages_async(conversation, 5000).start(); // 5000 = Default poll interval
+    Conversation& conversation = this->conversations.emplace(std::move(stream_url), std::move(*live_stream_info));
+    this->conversation_ids.emplace(conversation.stream_url, conversation.id);
+    conversation.video_id = video_id.c_str();
+    this->video_conversation_ids.emplace(conversation.video_id, conversation.id);
+    conversation.channel_id = std::move(channel_id);
+    conversation.keep_warm = ClientContext::get_default().keep_warm(YOUTUBE_API_BASE_URL);
+    if(is_upcoming) {
+        g_message("Waiting for %s to start", conversation.stream_url.c_str());
+        schedule_upcoming_check(conversation);
+    } else {
+        start_chat(conversation);
+    }
+    co_return {};
+}
+
+void ChatClient::Impl::start_chat(Conversation& conversation)
+{
+    // If another client (or conversation) is already receiving this chat, get its batches instead of
+    // polling the same chat twice
+    conversation.shared_chat = std::make_shared<SharedChatMember>(get_context(), conversation.priority,
+        [this, id = conversation.id](peel::RefPtr<MessageBatch> batch) {
+            if(auto* match = this->conversations.get(id)) {
+                deliver_batch(*match, std::move(batch));
+            }
+        },
+        [this, id = conversation.id](guint poll_interval, peel::String next_page_token) {
+            if(auto* match = this->conversations.get(id)) {
+                g_message("Taking over polling of %s", match->stream_url.c_str());
+                fetch_messages_async(id, poll_interval ? poll_interval : DEFAULT_POLL_INTERVAL,
+                                     std::move(next_page_token)).start();
+            }
+        },
+        [this, id = conversation.id] {
+            if(auto* match = this->conversations.get(id)) {
+                on_poll_priority_changed(*match);
+            }
+        });
+    auto& registry = LiveChatRegistry::get_default();
+    const char* live_chat_id = conversation.stream_info.live_chat_id.c_str();
+    bool is_fetcher = registry.join(live_chat_id, conversation.shared_chat);
+    if(is_fetcher) {
+        this->fetch_messages_async(conversation.id, DEFAULT_POLL_INTERVAL).start();
+    } else {
+        // This conversation may want the chat polled more eagerly than the others
+        registry.update_priority(live_chat_id);
+    }
+}
+
+void ChatClient::Impl::schedule_upcoming_check(Conversation& conversation)
+{
+    // Check a few times over the remaining wait, more and more often as the start time approaches,
+    // so that polling begins close to the moment the broadcast goes live. Broadcasts often start a
+    // little late, but the later one is, the less likely it is to start in the next few seconds
+    gint64 until_start = conversation.stream_info.scheduled_start_time->to_unix() * G_USEC_PER_SEC
+                         - g_get_real_time();
+    gint64 interval;
+    if(until_start > 0) {
+        interval = std::clamp<gint64>(until_start / 4 / 1000, UPCOMING_MIN_POLL_INTERVAL,
+                                      UPCOMING_MAX_POLL_INTERVAL);
+    } else {
+        interval = std::clamp<gint64>(-until_start / 4 / 1000, UPCOMING_MIN_POLL_INTERVAL,
+                                      UPCOMING_LATE_MAX_POLL_INTERVAL);
+    }
+    conversation.fetch_messages_source = timeout_add_once_local((guint)interval,
+        [this, id = conversation.id, fetch_cancel = conversation.fetch_cancel] {
+            if(!fetch_cancel->is_cancelled()) {
+                check_upcoming_async(id).start();
+            }
+        });
+}
+
+Task<void> ChatClient::Impl::check_upcoming_async(ConversationId id)
+{
+    Conversation* match = this->conversations.get(id);
+    if(!match) {
+        co_return {};
+    }
+    Conversation& conversation = *match;
+    auto& stream_url = conversation.stream_url;
+    conversation.fetch_messages_source.disconnect();
 
+    // Outlives the conversation, which is destroyed if it is disconnected while this is running
+    peel::RefPtr<gio::Cancellable> fetch_cancel = conversation.fetch_cancel;
+    auto live_stream_info = co_await this->get_live_stream_info_async(conversation.video_id.c_str(), fetch_cancel);
+    if(fetch_cancel->is_cancelled()) {
+        co_return {};
+    }
+    if(!live_stream_info.has_value()) {
+        auto& error = live_stream_info.error();
+        if(error->domain == YOUTUBE_CHAT_ERROR && error->code == YOUTUBE_CHAT_ERROR_CHAT_ENDED) {
+            // Ended (or was cancelled) without the chat ever going live
+            end_chat(conversation);
+            co_return std::move(error);
+        }
+        // Possibly a temporary failure; keep waiting
+        g_warning("Failed to check whether %s has started: %s",
+                  stream_url.c_str(), live_stream_info.error()->message);
+        schedule_upcoming_check(conversation);
+        co_return std::move(live_stream_info.error());
+    }
+    bool has_started = (bool)live_stream_info->live_chat_id;
+    // Keep the title and start time up to date, since they can be changed until the broadcast starts
+    if(live_stream_info->scheduled_start_time || has_started) {
+        conversation.stream_info = std::move(*live_stream_info);
+    }
+    if(has_started) {
+        // Without a page token, the first poll returns the chat from the beginning, so no messages
+        // from the start of the broadcast are missed
+        g_message("%s has started", stream_url.c_str());
+        start_chat(conversation);
+        co_return {};
+    }
+    auto* start_time = conversation.stream_info.scheduled_start_time.get();
+    if(g_get_real_time() - start_time->to_unix() * G_USEC_PER_SEC > UPCOMING_MAX_LATENESS) {
+        ErrorPtr error(YOUTUBE_CHAT_ERROR, 1, "Stream %s never started", stream_url.c_str());
+        emit_error(error);
+        // Otherwise it would stay connected with nothing left to check, so could never be rejoined
+        end_chat(conversation);
+        co_return error;
+    }
+    schedule_upcoming_check(conversation);
     co_return {};
 }
 
 void ChatClient::disconnect()
 {
-    m_impl->conversations.clear();
-    m_impl->refresh_timer_source.disconnect();
-    m_impl->refresh_cancel->cancel();
-    m_impl->is_authorized = false;
+    m_impl->run_sync([&] {
+        m_impl->remove_all_conversations();
+        auto& moderation = *m_impl->moderation;
+        for(auto& request : moderation.waiting) {
+            request->complete(ErrorPtr(YOUTUBE_CHAT_ERROR, 1, "Disconnected before the action was sent"));
+        }
+        moderation.waiting.clear();
+        moderation.by_key.clear();
+        moderation.retry_source.disconnect();
+        m_impl->resync_source.disconnect();
+        ClientContext::get_default().cancel_refresh(m_impl.get());
+        m_impl->refresh_cancel->cancel();
+        m_impl->is_authorized = false;
+    });
 }
 
-void ChatClient::disconnect_chat(const char* stream_url)
+AsyncStream<peel::RefPtr<MessageBatch>> ChatClient::subscribe(const char* stream_url, std::size_t max_buffered)
 {
-    auto conversation = m_impl->conversations.find(stream_url);
-    if(conversation == m_impl->conversations.end()) {
+    AsyncStream<peel::RefPtr<MessageBatch>> stream{max_buffered};
+    bool is_connected = m_impl->run_sync([&] {
+        auto* conversation = m_impl->find_conversation(stream_url);
+        if(!conversation) {
+            return false;
+        }
+        conversation->subscribers.push_back(stream);
+        return true;
+    });
+    if(!is_connected) {
         g_warning("Unknown conversation: %s", stream_url);
-        return;
+        stream.close();
     }
-    m_impl->conversations.erase(conversation);
+    return stream;
+}
+
+void ChatClient::disconnect_chat(const char* stream_url)
+{
+    m_impl->run_sync([&] {
+        auto* conversation = m_impl->find_conversation(stream_url);
+        if(!conversation) {
+            g_warning("Unknown conversation: %s", stream_url);
+            return;
+        }
+        m_impl->remove_conversation(*conversation);
+    });
 }
 
 Task<StreamInfo> ChatClient::Impl::get_live_stream_info_async(peel::String video_id, gio::Cancellable* cancellable)
@@ -496,115 +1584,641 @@ Task<StreamInfo> ChatClient::Impl::get_live_stream_info_async(peel::String video
             co_return std::unexpected(error);
         }
     }
-    auto call = this->proxy->new_call();
-    call->add_param("part", "snippet,liveStreamingDetails");
-    call->add_param("fields", "items(snippet(title),liveStreamingDetails(activeLiveChatId))");
-    call->add_param("id", video_id);
-    call->set_function("videos");
+    auto url = build_api_url("videos", {
+        {"part", "snippet,liveStreamingDetails"},
+        {"fields", "items(snippet(title),liveStreamingDetails(activeLiveChatId,scheduledStartTime,actualEndTime))"},
+        {"id", video_id.c_str()},
+    });
+    auto response = co_await send_api_request(Endpoint::Videos, "GET", url, nullptr, cancellable);
+    if(!response.has_value()) {
+        co_return std::unexpected(std::move(response.error()));
+    }
+    co_return parse_stream_info(get_bytes_data(*response));
+}
 
-    {
-        AsyncResult result;
-        peel::UniquePtr<glib::Error> error;
-        call->invoke_async(cancellable, result.callback());
-        call->invoke_finish(co_await result, &error);
-        if(error) {
-            co_return std::unexpected(std::move(error));
+Task<std::pair<peel::String, std::string>> ChatClient::Impl::resolve_video_id_async(
+    StreamUrlTarget target, gio::Cancellable* cancellable)
+{
+    using Kind = StreamUrlTarget::Kind;
+    if(target.kind == Kind::Video) {
+        co_return std::pair{peel::String::adopt_string(g_strndup(target.id.data(), target.id.size())), std::string{}};
+    }
+
+    std::string channel_id;
+    if(target.kind == Kind::Handle) {
+        if(auto* cached = this->channel_ids.get(target.id, g_get_monotonic_time())) {
+            channel_id = *cached;
+        } else {
+            std::string handle{target.id};
+            auto url = build_api_url("channels", {{"part", "id"}, {"forHandle", handle.c_str()}});
+            auto response = co_await send_api_request(Endpoint::Channels, "GET", url, nullptr, cancellable);
+            if(!response.has_value()) {
+                co_return std::unexpected(std::move(response.error()));
+            }
+            auto found_id = parse_channel_id(get_bytes_data(*response));
+            if(!found_id.has_value()) {
+                co_return std::unexpected(std::move(found_id.error()));
+            }
+            channel_id = found_id->c_str();
+            this->channel_ids.put(std::move(handle), channel_id, g_get_monotonic_time());
         }
+    } else {
+        channel_id = target.id;
     }
-    const char* response = call->get_payload();
-    auto response_len = call->get_payload_length();
-    co_return parse_stream_info(peel::ArrayRef{response, (guint)response_len});
+
+    if(auto* cached = this->live_videos.get(channel_id, g_get_monotonic_time())) {
+        co_return std::pair{peel::String{cached->c_str()}, std::move(channel_id)};
+    }
+    auto url = build_api_url("search", {
+        {"part", "id"},
+        {"channelId", channel_id.c_str()},
+        {"eventType", "live"},
+        {"type", "video"},
+        {"maxResults", "1"},
+    });
+    auto response = co_await send_api_request(Endpoint::Search, "GET", url, nullptr, cancellable);
+    if(!response.has_value()) {
+        co_return std::unexpected(std::move(response.error()));
+    }
+    auto video_id = parse_search_video_id(get_bytes_data(*response));
+    if(!video_id.has_value()) {
+        co_return std::unexpected(std::move(video_id.error()));
+    }
+    this->live_videos.put(channel_id, video_id->c_str(), g_get_monotonic_time());
+    co_return std::pair{std::move(*video_id), std::move(channel_id)};
 }
 
 Task<void> ChatClient::send_message_async(std::string stream_url, const char* message, gio::Cancellable* cancellable)
 {
-    g_assert(m_impl->is_authorized);
-    if(m_impl->is_access_expired()) {
-        // Note: use passed in cancellable instead of m_impl->cancellable since this is a one-off
-        //   operation and not a periodic operation
-        auto error = co_await m_impl->refresh_access_token_async(cancellable);
-        if(error) {
-            co_return error;
-        }
-    }
+    // The caller's buffer only has to live until the first suspension point
+    std::string text = message;
+    co_await m_impl->enter_client_context();
+    auto error = co_await m_impl->send_message_async(std::move(stream_url), text.c_str(), cancellable);
+    co_await m_impl->enter_ui_context();
+    co_return error;
+}
 
-    auto conversation = m_impl->conversations.find(stream_url);
-    if(conversation == m_impl->conversations.end()) {
+Task<void> ChatClient::Impl::send_message_async(std::string stream_url, const char* message, gio::Cancellable* cancellable)
+{
+    g_assert(this->is_authorized);
+    auto* conversation = find_conversation(stream_url);
+    if(!conversation) {
         g_warning("Unknown conversation: %s", stream_url.c_str());
         co_return {};
     }
+    if(!conversation->stream_info.live_chat_id) {
+        co_return ErrorPtr(YOUTUBE_CHAT_ERROR, 1, "Stream has not started yet");
+    }
 
-    auto message_json_str = create_text_message(conversation->second.stream_info.live_chat_id, message);
-    auto call = JsonSnippetPoster::create(m_impl->proxy, std::move(message_json_str));
-    call->set_function("liveChat/messages");
+    // Messages are posted in the order they were sent, so queue it behind any others
+    auto outgoing = std::make_shared<OutgoingMessage>(message, cancellable);
+    conversation->outbox.push_back(outgoing);
+    if(!conversation->is_sending) {
+        drain_outbox_async(conversation->id).start();
+    }
+    co_return co_await WaitForSend{outgoing};
+}
 
-    AsyncResult result;
-    peel::UniquePtr<glib::Error> error;
-    // Note: use passed in cancellable instead of m_impl->cancellable since this is a one-off
-    //   operation and not a periodic operation
-    call->invoke_async(cancellable, result.callback());
-    call->invoke_finish(co_await result, &error);
+Task<void> ChatClient::Impl::drain_outbox_async(ConversationId id)
+{
+    Conversation* match = this->conversations.get(id);
+    if(!match) {
+        co_return {};
+    }
+    Conversation& conversation = *match;
+    // Outlives the conversation, which is destroyed (failing everything left in the outbox) if it is
+    // disconnected while this is suspended
+    peel::RefPtr<gio::Cancellable> fetch_cancel = conversation.fetch_cancel;
+    conversation.is_sending = true;
+    if(!this->send_message_url) {
+        this->send_message_url = build_api_url("liveChat/messages", {{"part", "snippet"}});
+    }
+    while(!conversation.outbox.empty()) {
+        auto outgoing = conversation.outbox.front();
+        if(outgoing->cancellable && outgoing->cancellable->is_cancelled()) {
+            conversation.outbox.pop_front();
+            outgoing->complete(ErrorPtr(G_IO_ERROR, G_IO_ERROR_CANCELLED, "Sending the message was cancelled"));
+            continue;
+        }
+        if(guint wait_time = conversation.send_limit.get_wait_time(g_get_monotonic_time())) {
+            co_await SleepFor{wait_time};
+            if(fetch_cancel->is_cancelled()) {
+                co_return {};
+            }
+            continue;
+        }
+        conversation.send_limit.try_take(g_get_monotonic_time());
+        if(this->is_access_expired()) {
+            auto error = co_await this->refresh_access_token_async(outgoing->cancellable);
+            if(fetch_cancel->is_cancelled()) {
+                co_return {};
+            }
+            if(error) {
+                conversation.outbox.pop_front();
+                outgoing->complete(std::move(error));
+                continue;
+            }
+        }
+
+        write_text_message(this->send_buffer, conversation.stream_info.live_chat_id.c_str(), outgoing->text.c_str());
+        GBytes* body = g_bytes_new(this->send_buffer->str, this->send_buffer->len);
+        auto response = co_await send_api_request(
+            Endpoint::SendMessage, "POST", this->send_message_url.c_str(), body, outgoing->cancellable);
+        g_bytes_unref(body);
+        if(fetch_cancel->is_cancelled()) {
+            co_return {};
+        }
+        if(!response.has_value()) {
+            auto& error = response.error();
+            if(error->domain == YOUTUBE_CHAT_ERROR && error->code == YOUTUBE_CHAT_ERROR_RATE_LIMITED
+               && outgoing->attempts < MAX_SEND_RETRIES) {
+                // Back off (and hold back the rest of the outbox) before trying the same message again
+                guint delay = SEND_RETRY_DELAY << outgoing->attempts++;
+                g_warning("Rate limited posting to %s; retrying in %u ms", conversation.stream_url.c_str(), delay);
+                conversation.send_limit.drain(g_get_monotonic_time());
+                co_await SleepFor{delay};
+                if(fetch_cancel->is_cancelled()) {
+                    co_return {};
+                }
+                continue;
+            }
+            conversation.outbox.pop_front();
+            outgoing->complete(std::move(error));
+            continue;
+        }
+        conversation.outbox.pop_front();
+        outgoing->complete({});
+    }
+    conversation.is_sending = false;
+    co_return {};
+}
+
+Task<void> ChatClient::ban_user_async(std::string stream_url, const char* channel_id, gio::Cancellable* cancellable)
+{
+    // Copies the target, which the caller only has to keep alive until the first suspension point
+    ModerationAction action{ModerationAction::Type::Ban, channel_id};
+    co_await m_impl->enter_client_context();
+    auto error = co_await m_impl->moderate_async(std::move(stream_url), std::move(action), cancellable);
+    co_await m_impl->enter_ui_context();
     co_return error;
 }
 
+Task<void> ChatClient::timeout_user_async(std::string stream_url, const char* channel_id, guint duration_seconds,
+                                          gio::Cancellable* cancellable)
+{
+    ModerationAction action{ModerationAction::Type::Timeout, channel_id, duration_seconds};
+    co_await m_impl->enter_client_context();
+    auto error = co_await m_impl->moderate_async(std::move(stream_url), std::move(action), cancellable);
+    co_await m_impl->enter_ui_context();
+    co_return error;
+}
+
+Task<void> ChatClient::delete_message_async(std::string stream_url, const char* message_id, gio::Cancellable* cancellable)
+{
+    ModerationAction action{ModerationAction::Type::DeleteMessage, message_id};
+    co_await m_impl->enter_client_context();
+    auto error = co_await m_impl->moderate_async(std::move(stream_url), std::move(action), cancellable);
+    co_await m_impl->enter_ui_context();
+    co_return error;
+}
+
+Task<std::vector<ErrorPtr>> ChatClient::moderate_async(std::string stream_url, std::vector<ModerationAction> actions,
+                                                       gio::Cancellable* cancellable)
+{
+    co_await m_impl->enter_client_context();
+    auto results = co_await when_all(actions.size(), [&](std::size_t i) {
+        return m_impl->moderate_async(stream_url, std::move(actions[i]), cancellable);
+    });
+    std::vector<ErrorPtr> errors;
+    errors.reserve(results.size());
+    for(auto& result : results) {
+        errors.push_back(result.has_value() ? ErrorPtr{} : std::move(result.error()));
+    }
+    co_await m_impl->enter_ui_context();
+    co_return errors;
+}
+
+Task<void> ChatClient::Impl::moderate_async(std::string stream_url, ModerationAction action, gio::Cancellable* cancellable)
+{
+    if(action.type == ModerationAction::Type::Timeout && action.duration_seconds == 0) {
+        // The API would take a timeout without a duration as a permanent ban
+        co_return ErrorPtr(YOUTUBE_CHAT_ERROR, 1, "Timeout duration must be at least one second");
+    }
+    auto* conversation = find_conversation(stream_url);
+    if(!conversation) {
+        co_return ErrorPtr(YOUTUBE_CHAT_ERROR, 1, "Unknown conversation: %s", stream_url.c_str());
+    }
+    if(!conversation->stream_info.live_chat_id) {
+        co_return ErrorPtr(YOUTUBE_CHAT_ERROR, 1, "Stream has not started yet");
+    }
+    if(cancellable && cancellable->is_cancelled()) {
+        co_return ErrorPtr(G_IO_ERROR, G_IO_ERROR_CANCELLED, "Moderation action was cancelled");
+    }
+    // A banned user doesn't need a timeout either
+    auto& already_done = action.type == ModerationAction::Type::DeleteMessage
+                         ? conversation->deleted_messages : conversation->banned_channels;
+    if(already_done.contains(action.target)) {
+        co_return {};
+    }
+
+    const char* live_chat_id = conversation->stream_info.live_chat_id.c_str();
+    auto key = glib::strdup_printf("%s/%d/%s", live_chat_id, (int)action.type, action.target.c_str());
+    // Repeating an action that is already queued or in flight just waits for its outcome
+    auto& queued = this->moderation->by_key[key.c_str()];
+    std::shared_ptr<ModerationRequest> request = queued;
+    if(!request) {
+        request = std::make_shared<ModerationRequest>(key.c_str(), conversation->id, live_chat_id,
+                                                      std::move(action), conversation->fetch_cancel);
+        queued = request;
+        this->moderation->waiting.push_back(request);
+        pump_moderation_queue();
+    }
+    co_return co_await WaitForModeration{request};
+}
+
+void ChatClient::Impl::pump_moderation_queue()
+{
+    auto& queue = *this->moderation;
+    while(!queue.waiting.empty() && queue.in_flight < MAX_MODERATION_REQUESTS && !queue.retry_source) {
+        auto request = queue.waiting.front();
+        if(request->cancellable->is_cancelled()) {
+            // Its conversation was disconnected
+            queue.waiting.pop_front();
+            queue.forget(request);
+            request->complete(ErrorPtr(YOUTUBE_CHAT_ERROR, 1, "Disconnected before the action was sent"));
+            continue;
+        }
+        if(guint wait_time = queue.limit.get_wait_time(g_get_monotonic_time())) {
+            queue.retry_source = timeout_add_once_local(wait_time, [this] {
+                this->moderation->retry_source.release();
+                pump_moderation_queue();
+            });
+            return;
+        }
+        queue.limit.try_take(g_get_monotonic_time());
+        queue.waiting.pop_front();
+        ++queue.in_flight;
+        send_moderation_async(std::move(request)).start();
+    }
+}
+
+Task<void> ChatClient::Impl::send_moderation_async(std::shared_ptr<ModerationRequest> request)
+{
+    // Outlives the client, which may be destroyed while this is suspended
+    std::shared_ptr<ModerationQueue> queue = this->moderation;
+    if(this->is_access_expired()) {
+        auto error = co_await this->refresh_access_token_async(request->cancellable);
+        if(queue->is_closed) {
+            // close() already failed the request
+            co_return {};
+        }
+        if(error) {
+            --queue->in_flight;
+            queue->forget(request);
+            request->complete(std::move(error));
+            pump_moderation_queue();
+            co_return {};
+        }
+    }
+
+    const ModerationAction& action = request->action;
+    peel::RefPtr<glib::Bytes> response;
+    ErrorPtr error;
+    if(action.type == ModerationAction::Type::DeleteMessage) {
+        auto url = build_api_url("liveChat/messages", {{"id", action.target.c_str()}});
+        auto result = co_await send_api_request(Endpoint::Moderation, "DELETE", url, nullptr, request->cancellable);
+        if(!result.has_value()) {
+            error = std::move(result.error());
+        }
+    } else {
+        if(!this->ban_url) {
+            this->ban_url = build_api_url("liveChat/bans", {{"part", "snippet"}});
+        }
+        guint duration = action.type == ModerationAction::Type::Timeout ? action.duration_seconds : 0;
+        write_ban_request(this->send_buffer, request->live_chat_id.c_str(), action.target.c_str(), duration);
+        GBytes* body = g_bytes_new(this->send_buffer->str, this->send_buffer->len);
+        auto result = co_await send_api_request(
+            Endpoint::Moderation, "POST", this->ban_url.c_str(), body, request->cancellable);
+        g_bytes_unref(body);
+        if(!result.has_value()) {
+            error = std::move(result.error());
+        }
+    }
+    if(queue->is_closed) {
+        // close() already failed the request
+        co_return {};
+    }
+    --queue->in_flight;
+
+    if(error && error->domain == YOUTUBE_CHAT_ERROR && error->code == YOUTUBE_CHAT_ERROR_RATE_LIMITED
+       && request->attempts < MAX_MODERATION_RETRIES) {
+        // Hold back everything (not just this request) since the limit is shared
+        guint delay = MODERATION_RETRY_DELAY << request->attempts++;
+        g_warning("Rate limited sending moderation actions; retrying in %u ms", delay);
+        queue->limit.drain(g_get_monotonic_time());
+        queue->waiting.push_front(std::move(request));
+        queue->retry_source = timeout_add_once_local(delay, [this] {
+            this->moderation->retry_source.release();
+            pump_moderation_queue();
+        });
+        co_return {};
+    }
+
+    queue->forget(request);
+    if(!error && action.type != ModerationAction::Type::Timeout) {
+        if(auto* conversation = this->conversations.get(request->conversation)) {
+            auto& done = action.type == ModerationAction::Type::Ban
+                         ? conversation->banned_channels : conversation->deleted_messages;
+            done.insert(action.target);
+        }
+    }
+    request->complete(std::move(error));
+    pump_moderation_queue();
+    co_return {};
+}
+
 Task<void> ChatClient::Impl::fetch_messages_async(
-    ConversationIterator iter, guint poll_interval, peel::String next_page_token)
+    ConversationId id, guint poll_interval, peel::String next_page_token)
 {
     g_assert(this->is_authorized);
 
-    auto& stream_url = iter->first;
-    Conversation& conversation = iter->second;
-    conversation.fetch_messages_source.disconnect();
+    Conversation* conversation = this->conversations.get(id);
+    if(!conversation) {
+        co_return {};
+    }
+    conversation->fetch_messages_source.disconnect();
+    if(this->is_paused) {
+        conversation->pending_poll = PendingPoll{poll_interval, std::move(next_page_token)};
+        co_return {};
+    }
 
+    // Outlives the conversation, which is destroyed if it is disconnected while this is suspended
+    peel::RefPtr<gio::Cancellable> fetch_cancel = conversation->fetch_cancel;
     if(this->is_access_expired()) {
-        auto error = co_await this->refresh_access_token_async(conversation.fetch_cancel);
+        // Waiters on a refresh that is already running aren't woken by fetch_cancel, so check it too
+        auto error = co_await this->refresh_access_token_async(fetch_cancel);
+        if(fetch_cancel->is_cancelled() || !(conversation = this->conversations.get(id))) {
+            co_return {};
+        }
         if(error) {
+            retry_fetch(*conversation, poll_interval, std::move(next_page_token), error);
             co_return error;
         }
     }
 
-    auto call = this->proxy->new_call();
-    call->add_param("liveChatId", conversation.stream_info.live_chat_id);
-    call->add_param("part", "snippet,authorDetails");
-    call->add_param("fields", "nextPageToken,pollingIntervalMillis,"
-                              "items(id,authorDetails(channelId,displayName,isChatModerator),"
-                              "snippet(type,publishedAt,displayMessage,"
-                                "userBannedDetails(banType,bannedUserDetails(channelId,displayName))))");
+    if(conversation->poll_url.empty()) {
+        auto prefix = build_api_url("liveChat/messages", {
+            {"liveChatId", conversation->stream_info.live_chat_id.c_str()},
+            {"part", "snippet,authorDetails"},
+            {"fields", "nextPageToken,pollingIntervalMillis,offlineAt,"
+                       "items(id,authorDetails(channelId,displayName,isChatModerator),"
+                       "snippet(type,publishedAt,displayMessage,"
+                         "userBannedDetails(banType,bannedUserDetails(channelId,displayName)),"
+                         "messageDeletedDetails(deletedMessageId),"
+                         "messageRetractedDetails(retractedMessageId)))"},
+        });
+        conversation->poll_url = prefix.c_str();
+        conversation->poll_url_prefix_len = conversation->poll_url.size();
+        // Leave room for page tokens so that polls don't have to grow the string
+        conversation->poll_url.reserve(conversation->poll_url_prefix_len + 256);
+    }
+    conversation->poll_url.resize(conversation->poll_url_prefix_len);
     if(next_page_token) {
         // Only request messages we haven't seen before
-        call->add_param("pageToken", next_page_token);
+        conversation->poll_url += "&pageToken=";
+        append_uri_escaped(conversation->poll_url, next_page_token.c_str());
     }
-    call->set_function("liveChat/messages");
 
-    {
-        AsyncResult result;
-        peel::UniquePtr<glib::Error> error;
-        g_print("Poll interval: %u\n", poll_interval);
-        call->invoke_async(conversation.fetch_cancel, result.callback());
-        call->invoke_finish(co_await result, &error);
-        if(error) {
-            // TODO: implement some kind of retry mechanism then give up
-            // Note: will try again using the last known polling interval
-            sig_error.emit(this->client, error);
-            co_return error;
+    g_debug("Poll interval: %u", poll_interval);
+    auto response = co_await send_api_request(
+        Endpoint::LiveChatMessages, "GET", conversation->poll_url.c_str(), nullptr, fetch_cancel);
+    if(fetch_cancel->is_cancelled() || !(conversation = this->conversations.get(id))) {
+        // Disconnected while the request was in flight
+        co_return {};
+    }
+    if(!response.has_value()) {
+        auto& error = response.error();
+        if(this->is_paused) {
+            // Lost connectivity while waiting on the response; try again once it's back
+            conversation->pending_poll = PendingPoll{poll_interval, std::move(next_page_token)};
+            co_return std::move(error);
+        }
+        if(is_timeout_error(error)) {
+            // Most likely a stalled connection; poll again rather than leaving the chat frozen
+            g_warning("Timed out fetching messages for %s", conversation->stream_url.c_str());
+            schedule_fetch(*conversation, poll_interval, std::move(next_page_token));
+            co_return std::move(error);
         }
+        if(error->domain == YOUTUBE_CHAT_ERROR && error->code == YOUTUBE_CHAT_ERROR_CHAT_ENDED) {
+            end_chat(*conversation);
+            co_return std::move(error);
+        }
+        retry_fetch(*conversation, poll_interval, std::move(next_page_token), error);
+        co_return std::move(error);
     }
-    const char* response = call->get_payload();
-    auto response_len = call->get_payload_length();
-    auto messages_info = parse_chat_messages(peel::ArrayRef{response, (guint)response_len});
+    conversation->poll_failures = 0;
+    BatchTimestamps timestamps;
+    timestamps.received_at = g_get_real_time();
+    timestamps.clock_offset = this->clock_offset.load(std::memory_order_relaxed);
+    gint64 parse_start = g_get_monotonic_time();
+    auto messages_info = parse_chat_messages(get_bytes_data(*response));
+    this->metrics.parse_time.record(g_get_monotonic_time() - parse_start);
+    timestamps.parsed_at = g_get_real_time();
     if(!messages_info.has_value()) {
-        sig_error.emit(this->client, messages_info.error().get());
+        this->metrics.errors[(std::size_t)ErrorClass::Parse].fetch_add(1, std::memory_order_relaxed);
+        retry_fetch(*conversation, poll_interval, std::move(next_page_token), messages_info.error());
         co_return std::move(messages_info.error());
     }
-    if(!messages_info->messages.empty()) {
-        // Notify all listeners that a new batch of messages has been received
-        peel::ArrayRef<const ChatMessage> messages_span{messages_info->messages.data(), messages_info->messages.size()};
-        sig_new_messages.emit(this->client, stream_url.c_str(), (void*)&messages_span);
+    peel::RefPtr<MessageBatch> batch;
+    bool has_messages = !messages_info->messages.empty();
+    if(has_messages) {
+        this->metrics.batches_received.fetch_add(1, std::memory_order_relaxed);
+        this->metrics.messages_received.fetch_add(messages_info->messages.size(), std::memory_order_relaxed);
+    }
+    if(has_messages) {
+        // How far behind the server the poll was, by the server's clock
+        gint64 server_now = timestamps.received_at + timestamps.clock_offset;
+        for(const auto& message : messages_info->messages) {
+            if(message.timestamp) {
+                this->metrics.receive_latency.record(server_now - message.get_published_at());
+            }
+        }
+        batch = MessageBatch::create(std::move(messages_info->messages), timestamps);
+    }
+    // Pass the batch on to any other conversations in this chat
+    LiveChatRegistry::get_default().publish(conversation->stream_info.live_chat_id.c_str(),
+                                            conversation->shared_chat.get(), batch,
+                                            messages_info->poll_interval, messages_info->next_page_token.c_str());
+    if(batch) {
+        deliver_batch(*conversation, std::move(batch));
+    }
+    if(messages_info->offline_at) {
+        end_chat(*conversation);
+        co_return {};
+    }
+
+    guint next_poll_interval = messages_info->poll_interval;
+    conversation->idle_polls = has_messages ? 0 : conversation->idle_polls + 1;
+    auto priority = get_poll_priority(*conversation);
+    conversation->poll_priority = priority;
+    // Most of the time a silent chat stays silent, so poll it less and less often (within limits)
+    // until someone says something. Not done for the chats the user is looking at
+    if(priority != ChatPriority::Foreground && conversation->idle_polls > IDLE_POLLS_BEFORE_DECAY) {
+        next_poll_interval = std::max(next_poll_interval,
+                                      std::min<guint>(poll_interval + poll_interval / 2, IDLE_MAX_POLL_INTERVAL));
+    }
+    if(priority == ChatPriority::Background) {
+        next_poll_interval = std::max(next_poll_interval, messages_info->poll_interval
+                                      * this->background_poll_multiplier.load(std::memory_order_relaxed));
+    }
+    schedule_fetch(*conversation, next_poll_interval, std::move(messages_info->next_page_token));
+    co_return {};
+}
+
+void ChatClient::Impl::deliver_batch(Conversation& conversation, peel::RefPtr<MessageBatch> batch)
+{
+    std::erase_if(conversation.subscribers, [](auto& subscriber) { return subscriber.is_closed(); });
+    for(auto& subscriber : conversation.subscribers) {
+        subscriber.push(batch);
+    }
+    // Notify all listeners that a new batch of messages has been received
+    emit_new_messages(conversation.stream_url, std::move(batch));
+}
+
+void ChatClient::Impl::schedule_fetch(Conversation& conversation, guint poll_interval, peel::String next_page_token)
+{
+    conversation.pending_poll = PendingPoll{poll_interval, std::move(next_page_token)};
+    arm_pending_poll(conversation, poll_interval);
+}
+
+/* Polls again after a backoff. Once the poll has failed MAX_POLL_RETRIES times in a row (e.g. the
+   account is out of quota, or its token can't be refreshed), reports the error. Then, if other
+   clients are in the same chat, one of them takes over polling from where this one left off, and
+   this conversation goes back to receiving the chat through it. Otherwise it keeps retrying at the
+   longest backoff */
+void ChatClient::Impl::retry_fetch(
+    Conversation& conversation, guint poll_interval, peel::String next_page_token, const ErrorPtr& error)
+{
+    guint delay = std::max<guint>(POLL_RETRY_DELAY << std::min(conversation.poll_failures, (guint)MAX_POLL_RETRIES),
+                                  poll_interval);
+    if(conversation.poll_failures == MAX_POLL_RETRIES) {
+        // Out of retries: report it (once per run of failures), and let another client take over if
+        // there is one
+        ++conversation.poll_failures;
+        emit_error(error);
+        auto& registry = LiveChatRegistry::get_default();
+        const char* live_chat_id = conversation.stream_info.live_chat_id.c_str();
+        if(conversation.shared_chat && registry.get_subscriber_count(live_chat_id) >= 2) {
+            g_message("Handing over polling of %s", conversation.stream_url.c_str());
+            // Leaving promotes the next subscriber; rejoining puts this conversation at the back as
+            // a follower
+            registry.leave(live_chat_id, conversation.shared_chat.get());
+            if(!registry.join(live_chat_id, conversation.shared_chat)) {
+                conversation.poll_failures = 0;
+                return;
+            }
+            // Everyone else left in the meantime, so it's still up to this conversation
+        }
+    } else if(conversation.poll_failures < MAX_POLL_RETRIES) {
+        ++conversation.poll_failures;
+    }
+    // The conversation is still the chat's fetcher, so it must always have a poll armed: anyone who
+    // joins the chat later relies on it. Past MAX_POLL_RETRIES it keeps trying at the longest delay
+    g_warning("Failed to fetch messages for %s (retrying in %u ms): %s",
+              conversation.stream_url.c_str(), delay, error->message);
+    schedule_fetch(conversation, delay, std::move(next_page_token));
+}
+
+ChatPriority ChatClient::Impl::get_poll_priority(const Conversation& conversation) const
+{
+    if(!conversation.shared_chat) {
+        return conversation.priority;
+    }
+    return LiveChatRegistry::get_default().get_priority(conversation.stream_info.live_chat_id.c_str());
+}
+
+void ChatClient::Impl::on_poll_priority_changed(Conversation& conversation)
+{
+    auto priority = get_poll_priority(conversation);
+    auto old_priority = std::exchange(conversation.poll_priority, priority);
+    // Catch up right away instead of waiting out an interval meant for a lower priority
+    if(priority == ChatPriority::Foreground && old_priority != ChatPriority::Foreground
+       && conversation.pending_poll && !this->is_paused) {
+        arm_pending_poll(conversation, 0);
+    }
+}
+
+void ChatClient::Impl::arm_pending_poll(Conversation& conversation, guint delay)
+{
+    auto fetch = [this, id = conversation.id, fetch_cancel = conversation.fetch_cancel] {
+        // The conversation may have been disconnected while polling was paused. The cancellable is
+        // checked first since subscribers can outlive the client itself
+        if(!fetch_cancel->is_cancelled()) {
+            if(auto* match = this->conversations.get(id)) {
+                start_pending_poll(*match);
+            }
+        }
+    };
+    // Backpressure: don't poll again until every subscriber has room for another batch. Since the
+    // poll interval has usually passed by the time a subscriber catches up, poll right away then
+    for(auto& subscriber : conversation.subscribers) {
+        if(!subscriber.wait_for_room(std::move(fetch))) {
+            return;
+        }
+    }
+    conversation.fetch_messages_source = timeout_add_once_local(delay, std::move(fetch));
+}
+
+void ChatClient::Impl::start_pending_poll(Conversation& conversation)
+{
+    // Both the timer and a subscriber making room can get here for the same poll
+    auto& pending_poll = conversation.pending_poll;
+    if(!pending_poll) {
+        return;
+    }
+    auto poll = std::move(*pending_poll);
+    pending_poll.reset();
+    fetch_messages_async(conversation.id, poll.poll_interval, std::move(poll.next_page_token)).start();
+}
+
+void ChatClient::Impl::on_connectivity_changed(bool is_available, guint resync_delay)
+{
+    if(!is_available) {
+        // Polls that come due in the meantime wait in their conversation instead of failing
+        this->is_paused = true;
+        this->resync_source.disconnect();
+        return;
+    }
+    if(!this->is_paused) {
+        return;
+    }
+    this->is_paused = false;
+    this->resync_source = timeout_add_once_local(resync_delay, [this] {
+        this->resync_source.release();
+        resync_async().start();
+    });
+}
+
+Task<void> ChatClient::Impl::resync_async()
+{
+    if(this->is_authorized && this->is_access_expired()) {
+        // Once, up front, rather than from every conversation's poll
+        auto error = co_await this->refresh_access_token_async(this->refresh_cancel);
+        if(error) {
+            emit_error(error);
+        }
+    }
+    if(this->is_paused) {
+        // Lost connectivity again in the meantime
+        co_return {};
     }
-    conversation.fetch_messages_source = glib::timeout_add_once(messages_info->poll_interval,
-        [this, iter, next_page_token = std::move(messages_info->next_page_token),
-         poll_interval = messages_info->poll_interval] {
-        fetch_messages_async(iter, poll_interval, std::move(next_page_token)).start();
+    // Overdue polls would otherwise all go out at once
+    guint delay = 0;
+    this->conversations.for_each([&](Conversation& conversation) {
+        if(conversation.pending_poll) {
+            arm_pending_poll(conversation, delay);
+            delay += CONVERSATION_RESYNC_STAGGER;
+        }
     });
     co_return {};
 }
@@ -616,6 +2230,65 @@ bool ChatClient::Impl::is_access_expired() const
     return expiration->compare(now) <= 0;
 }
 
+static
+peel::String build_api_url(const char* function, std::initializer_list<std::pair<const char*, const char*>> params)
+{
+    GString* url = g_string_new(YOUTUBE_API_BASE_URL);
+    g_string_append(url, function);
+    char separator = '?';
+    for(auto [name, value] : params) {
+        if(!value) {
+            continue;
+        }
+        g_string_append_c(url, separator);
+        g_string_append(url, name);
+        g_string_append_c(url, '=');
+        g_string_append_uri_escaped(url, value, nullptr, false);
+        separator = '&';
+    }
+    return peel::String::adopt_string(g_string_free(url, false));
+}
+
+/* Like g_string_append_uri_escaped(), but without allocating (beyond growing `out`) */
+static
+void append_uri_escaped(std::string& out, const char* str)
+{
+    static constexpr char hex_digits[] = "0123456789ABCDEF";
+    for(const char* c = str; *c; ++c) {
+        if(g_ascii_isalnum(*c) || *c == '-' || *c == '.' || *c == '_' || *c == '~') {
+            out += *c;
+        } else {
+            out += '%';
+            out += hex_digits[(unsigned char)*c >> 4];
+            out += hex_digits[(unsigned char)*c & 0xF];
+        }
+    }
+}
+
+static
+peel::ArrayRef<const char> get_bytes_data(glib::Bytes* bytes)
+{
+    gsize size = 0;
+    auto* data = static_cast<const char*>(g_bytes_get_data(reinterpret_cast<GBytes*>(bytes), &size));
+    return peel::ArrayRef{data, (guint)size};
+}
+
+static
+Task<peel::RefPtr<glib::Bytes>> send_and_read_async(soup::Message* message, gio::Cancellable* cancellable)
+{
+    auto& client_context = ClientContext::get_default();
+    auto* session = client_context.get_session();
+    client_context.note_activity();
+    AsyncResult result;
+    peel::UniquePtr<glib::Error> error;
+    session->send_and_read_async(message, G_PRIORITY_DEFAULT, cancellable, result.callback());
+    auto response = session->send_and_read_finish(co_await result, &error);
+    if(error) {
+        co_return std::unexpected(std::move(error));
+    }
+    co_return std::move(response);
+}
+
 static
 peel::String build_server_error_response(const char* error_str)
 {
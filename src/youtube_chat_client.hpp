@@ -26,54 +26,111 @@ along with this program.  If not, see <https://www.gnu.org/licenses/>.
 #include <peel/String.h>
 #include <peel/signal.h>
 #include <peel/property.h>
+#include <cstddef>
 #include <memory>
 #include <expected>
 #include <string>
+#include <vector>
 #include "youtube_types.hpp"
 #include "error_wrapper.hpp"
 #include "task.hpp"
+#include "async_stream.hpp"
+#include "message_batch.hpp"
 
 namespace youtube {
 
-/* Manages a YouTube Live Chat connection. Low-level/does not depend on libpurple */
+/* Manages a YouTube Live Chat connection. Low-level/does not depend on libpurple.
+
+   If created with use_worker_thread, all network requests, parsing, and timers run on a thread owned by
+   the client. The public methods must still be called from (and their Tasks resume on) the thread that
+   created the client, which is also where all signals are emitted */
 class ChatClient final : public gobject::Object {
     PEEL_SIMPLE_CLASS(ChatClient, Object)
 public:
     ~ChatClient() noexcept;
 
     void init(Class*);
-    static peel::RefPtr<ChatClient> create(const char* client_id, const char* client_secret);
+    static peel::RefPtr<ChatClient> create(const char* client_id, const char* client_secret,
+                                           bool use_worker_thread = false);
     static peel::RefPtr<ChatClient> create_authorized(const char* client_id, const char* client_secret,
                                                       const char* access_token, const char* refresh_token,
-                                                      peel::RefPtr<glib::DateTime> access_token_expiration);
+                                                      peel::RefPtr<glib::DateTime> access_token_expiration,
+                                                      bool use_worker_thread = false);
+    // Warms up a connection to the YouTube API in the background. Safe to call before any client
+    // has been created
+    static void preconnect();
 
     std::expected<peel::String, ErrorPtr> generate_auth_url();
     Task<void> authorize();
-    Task<peel::String> get_user_display_name(gio::Cancellable*);
+    Task<ChannelIdentity> get_user_identity(gio::Cancellable*);
     Task<void> connect_to_chat_async(std::string stream_url, gio::Cancellable*);
     void disconnect();
     void disconnect_chat(const char* stream_url);
     Task<void> send_message_async(std::string stream_url, const char* message, gio::Cancellable*);
+    // Moderation. Actions go through a queue shared by all of the client's chats, which sends a few
+    // at a time within the API's rate limits. Each action is only sent once: repeating one that is
+    // still queued waits for the same outcome, and banning a user who has already been banned (or
+    // deleting a message that has already been deleted) succeeds without sending anything. The
+    // cancellable only applies until the action has been queued
+    Task<void> ban_user_async(std::string stream_url, const char* channel_id, gio::Cancellable*);
+    Task<void> timeout_user_async(std::string stream_url, const char* channel_id, guint duration_seconds,
+                                  gio::Cancellable*);
+    Task<void> delete_message_async(std::string stream_url, const char* message_id, gio::Cancellable*);
+    // Queues all of the actions at once. Returns one entry per action, in order: null if it succeeded
+    Task<std::vector<ErrorPtr>> moderate_async(std::string stream_url, std::vector<ModerationAction>,
+                                               gio::Cancellable*);
+    // Pull-based alternative to the new-messages signal: a stream of the message batches received
+    // for the conversation, in order. While max_buffered batches are waiting to be taken, polling for
+    // the conversation is paused (0 means never pause). Close the stream to unsubscribe. The client closes it when the
+    // conversation is disconnected; if the conversation is not connected, the stream starts closed
+    AsyncStream<peel::RefPtr<MessageBatch>> subscribe(const char* stream_url, std::size_t max_buffered = 16);
     bool is_authorized() const;
     bool is_chat_connected(const char* stream_url) const;
-    const char* get_title(const char* stream_url) const;
+    peel::String get_title(const char* stream_url) const;
     peel::String get_access_token() const;
     peel::String get_refresh_token() const;
     peel::RefPtr<glib::DateTime> get_access_token_expiration() const;
 
+    // Requests to the endpoint that take longer than this are cancelled and fail with
+    // YOUTUBE_CHAT_ERROR_TIMED_OUT. 0 means no limit
+    void set_request_timeout(Endpoint, guint timeout_ms);
+    guint get_request_timeout(Endpoint) const;
+    // Number of requests to the endpoint that have timed out so far
+    guint64 get_timeout_count(Endpoint) const;
+    // If enabled, joining a scheduled broadcast that hasn't started yet succeeds, and the client
+    // starts reading its chat as soon as it goes live. Otherwise joining it fails. Enabled by default
+    void set_watch_upcoming(bool);
+    // True if the conversation is waiting for its broadcast to start
+    bool is_chat_upcoming(const char* stream_url) const;
+    // Conversations start out as ChatPriority::Normal. Raising one to Foreground polls it right away,
+    // so that it's caught up by the time the user looks at it
+    void set_chat_priority(const char* stream_url, ChatPriority);
+    ChatPriority get_chat_priority(const char* stream_url) const;
+    // Background conversations are polled this many times less often than the API asks for
+    void set_background_poll_multiplier(guint);
+    ClientMetrics get_metrics() const;
+    // Emits metrics-updated every interval_ms milliseconds, so that whoever exports the metrics knows
+    // when to call get_metrics(). 0 (the default) turns this off
+    void set_metrics_interval(guint interval_ms);
+
     PEEL_SIGNAL_CONNECT_METHOD(new_messages, sig_new_messages)
     PEEL_SIGNAL_CONNECT_METHOD(error, sig_error);
     PEEL_SIGNAL_CONNECT_METHOD(tokens_changed, sig_tokens_changed)
     PEEL_SIGNAL_CONNECT_METHOD(access_token_expiration_changed, sig_access_token_expiration_changed)
+    PEEL_SIGNAL_CONNECT_METHOD(chat_ended, sig_chat_ended)
+    PEEL_SIGNAL_CONNECT_METHOD(metrics_updated, sig_metrics_updated)
 private:
     void on_tokens_changed(gobject::Object*, gobject::ParamSpec*);
     void on_access_token_expiration_changed(gobject::Object*, gobject::ParamSpec*);
 
-    // TODO: find way to pass std::ArrayRef<const ChatMessage> as a parameter
-    inline static peel::Signal<ChatClient, void(const char* stream_url, void*)> sig_new_messages;
+    // Handlers may keep a reference to the batch
+    inline static peel::Signal<ChatClient, void(const char* stream_url, MessageBatch*)> sig_new_messages;
     inline static peel::Signal<ChatClient, void(const glib::Error*)> sig_error;
     inline static peel::Signal<ChatClient, void(const char* access_token, const char* refresh_token)> sig_tokens_changed;
     inline static peel::Signal<ChatClient, void(glib::DateTime*)> sig_access_token_expiration_changed;
+    // The broadcast ended. The conversation has already been disconnected
+    inline static peel::Signal<ChatClient, void(const char* stream_url)> sig_chat_ended;
+    inline static peel::Signal<ChatClient, void()> sig_metrics_updated;
 
     struct Impl;
     std::unique_ptr<Impl> m_impl;
@@ -37,11 +37,23 @@ along with this program.  If not, see <https://www.gnu.org/licenses/>.
 #include <peel/Purple/Message.h>
 #include <peel/Purple/Ui.h>
 #include <peel/GLib/DateTime.h>
+#include <algorithm>
 #include <span>
+#include <deque>
+#include <list>
+#include <map>
 #include <optional>
+#include <string>
+#include <string_view>
+#include <unordered_map>
 #include <utility>
+#include <vector>
 #include "youtube_chat_client.hpp"
+#include "message_index.hpp"
+#include "string_hash.hpp"
+#include "event_source_token.hpp"
 #include "task.hpp"
+#include "task_combinators.hpp"
 
 static
 peel::String encode_tokens(const char* access_token, const char* refresh_token);
@@ -50,15 +62,301 @@ static
 std::optional<std::pair<peel::String, peel::String>>
 extract_access_and_refresh_tokens(const char* credentials);
 
+static
+guint get_uint_setting(purple::AccountSettings*, const char* name, guint default_value);
+
+static
+bool get_bool_setting(purple::AccountSettings*, const char* name, bool default_value);
+
 namespace youtube {
 
+#define DEFAULT_MESSAGE_HISTORY_DEPTH 2000
+// Seconds a conversation can fall behind before its low-priority messages are dropped
+#define DEFAULT_MAX_DELIVERY_LAG 10
+// Max time (in microseconds) spent writing messages per main loop iteration
+#define DELIVERY_SLICE_BUDGET 8000
+#define DEFAULT_MAX_CHAT_MEMBERS 2000
+// Minutes without posting before a chatter is removed from the member list
+#define DEFAULT_MEMBER_IDLE_TIMEOUT 30
+// How long (in microseconds) a mention keeps an unfocused conversation's priority raised. The UI may
+// never report focus, so the boost can't wait for the user to look at the conversation to end
+#define MENTION_BOOST_DURATION (5 * G_TIME_SPAN_MINUTE)
+#define DEFAULT_BACKGROUND_POLL_MULTIPLIER 4
+// Max number of members removed from a conversation at a time
+#define EVICTION_BATCH_SIZE 64
+#define EVICTION_INTERVAL_SECONDS 15
+// Seconds of p95 delivery latency (from a message being published to it being written) that a
+// conversation is expected to stay within. 0 turns the check off
+#define DEFAULT_DELIVERY_LATENCY_SLO 10
+// Seconds between metrics-updated emissions. 0 turns them off
+#define DEFAULT_METRICS_INTERVAL 0
+// The SLO is checked against the messages written during each window of this many seconds
+#define DELIVERY_SLO_WINDOW_SECONDS 60
+// Windows with fewer messages than this say too little about the p95 to act on
+#define DELIVERY_SLO_MIN_SAMPLES 20
+
 PEEL_CLASS_IMPL_DYNAMIC(Connection, "YoutubeConnection", purple::Connection)
 
+/* The Purple objects representing a chat participant, along with the last values that were
+   applied to them (so that Purple is only touched when something actually changes) */
+struct MemberState {
+    peel::RefPtr<purple::Contact> contact;
+    peel::RefPtr<purple::ConversationMember> member;
+    peel::String display_name;
+    // Monotonic time (in microseconds) when the member last posted
+    gint64 last_active = 0;
+    // Position in ConversationState::lru. Unused if the member is pinned
+    std::list<const std::string*>::iterator lru_position;
+    bool is_moderator = false;
+    // Pinned members (moderators and the account's own user) are never evicted
+    bool is_pinned = false;
+    // Set if the contact was created for this chat (rather than being one the user already had), so
+    // it is removed from the contact list along with the member
+    bool owns_contact = false;
+};
+
+/* A received message waiting to be written to its Purple conversation */
+struct PendingMessage {
+    // Keeps `message` alive
+    peel::RefPtr<MessageBatch> batch;
+    const ChatMessage* message;
+    // Monotonic time (in microseconds) when the message was received
+    gint64 received_at;
+};
+
+/* Messages waiting to be written to a Purple conversation. Messages in the priority lane
+   (Super Chats, bans, and moderator messages) are always written before those in the
+   normal lane */
+struct DeliveryQueue {
+    std::size_t size() const { return priority_lane.size() + normal_lane.size(); }
+    bool empty() const { return priority_lane.empty() && normal_lane.empty(); }
+
+    std::deque<PendingMessage> priority_lane;
+    std::deque<PendingMessage> normal_lane;
+    guint64 dropped_count = 0;
+    // Set while the conversation is far enough behind that messages are being dropped
+    bool is_behind = false;
+    // dropped_count when the conversation last fell behind
+    guint64 dropped_count_before = 0;
+};
+
+/* Purple-side state of a single live chat */
+struct ConversationState {
+    peel::RefPtr<purple::Conversation> conversation;
+    // Keyed by channel ID
+    std::unordered_map<std::string, MemberState, StringHash, std::equal_to<>> members;
+    // Channel IDs (owned by `members`) of the unpinned members, least recently active first
+    std::list<const std::string*> lru;
+    // Recently written messages, so that deletions/retractions can find the message they refer to
+    MessageIndex<peel::RefPtr<purple::Message>> messages;
+    DeliveryQueue pending;
+    // Unset until the UI reports focus for this conversation
+    std::optional<bool> is_focused;
+    // Messages mentioning the user received since the conversation was last focused, or since the
+    // priority boost from the last mention expired
+    guint unread_mentions = 0;
+    // Monotonic time (in microseconds) when the priority boost from the latest mention expires
+    gint64 mention_boost_until = 0;
+    // Time from each message being published to it being written, by the server's clock
+    LatencyHistogram delivery_latency;
+    // `delivery_latency` as of the start of the current SLO window
+    LatencyHistogram::Snapshot slo_window_start;
+    bool is_slo_breached = false;
+};
+
 struct Connection::Impl {
+    ConversationState* get_conversation_state(purple::Account*, const char* stream_url);
+    MemberState& get_member_state(purple::Account*, ConversationState&, const ChatMessage&, gint64 now);
+    void write_message(purple::Account*, ConversationState&, const PendingMessage&, gint64 now);
+    void drop_stale_messages(const std::string& stream_url, ConversationState&, gint64 now);
+    void evict_members(ConversationState&, gint64 now);
+    void update_priority(const char* stream_url, const ConversationState&);
+
     peel::RefPtr<ChatClient> client;
     peel::RefPtr<gio::Cancellable> cancellable;
+    std::map<std::string, ConversationState, std::less<>> conversations;
+    peel::RefPtr<purple::Badge> moderator_badge;
+    EventSourceToken delivery_source;
+    EventSourceToken eviction_source;
+    EventSourceToken slo_source;
+    // Handler for the conversation manager's present-conversation signal
+    gulong present_handler = 0;
+    peel::String own_channel_id;
+    guint message_history_depth = DEFAULT_MESSAGE_HISTORY_DEPTH;
+    guint max_delivery_lag = DEFAULT_MAX_DELIVERY_LAG;
+    guint max_chat_members = DEFAULT_MAX_CHAT_MEMBERS;
+    guint member_idle_timeout = DEFAULT_MEMBER_IDLE_TIMEOUT;
+    guint delivery_latency_slo = DEFAULT_DELIVERY_LATENCY_SLO;
 };
 
+ConversationState* Connection::Impl::get_conversation_state(purple::Account* account, const char* stream_url)
+{
+    auto state = this->conversations.find(std::string_view{stream_url});
+    if(state == this->conversations.end()) {
+        auto* conversation_manager = purple::Core::get_default()->get_conversation_manager();
+        peel::RefPtr conversation = conversation_manager->find(
+            account, purple::ConversationType::CHANNEL, stream_url);
+        if(!conversation) {
+            return nullptr;
+        }
+        state = this->conversations.try_emplace(stream_url).first;
+        state->second.conversation = std::move(conversation);
+        state->second.messages.set_capacity(this->message_history_depth);
+    }
+    return &state->second;
+}
+
+MemberState& Connection::Impl::get_member_state(
+    purple::Account* account, ConversationState& state, const ChatMessage& message, gint64 now)
+{
+    auto member_state = state.members.find(std::string_view{message.channel_id.c_str()});
+    if(member_state == state.members.end()) {
+        auto* contact_manager = purple::Core::get_default()->get_contact_manager();
+        MemberState new_state;
+        new_state.contact = contact_manager->find_with_id(account, message.channel_id.c_str());
+        if(!new_state.contact) {
+            new_state.contact = contact_manager->find_or_create(account, message.channel_id.c_str(), nullptr);
+            new_state.owns_contact = true;
+        }
+        new_state.member = state.conversation->get_members()->find_or_add_member(
+            new_state.contact, /*announce=*/false, /*message=*/"");
+        member_state = state.members.try_emplace(message.channel_id.c_str(), std::move(new_state)).first;
+        if(g_strcmp0(message.channel_id.c_str(), this->own_channel_id.c_str()) == 0) {
+            member_state->second.is_pinned = true;
+        } else {
+            member_state->second.lru_position = state.lru.insert(state.lru.end(), &member_state->first);
+        }
+    } else if(!member_state->second.is_pinned) {
+        // Mark as most recently active
+        state.lru.splice(state.lru.end(), state.lru, member_state->second.lru_position);
+    }
+
+    // Only notify Purple (and in turn the UI) when a value really changes
+    MemberState& result = member_state->second;
+    result.last_active = now;
+    if(g_strcmp0(result.display_name.c_str(), message.display_name.c_str()) != 0) {
+        result.contact->set_display_name(message.display_name.c_str());
+        result.display_name = message.display_name.c_str();
+    }
+    if(message.is_moderator && !result.is_moderator) {
+        if(!this->moderator_badge) {
+            this->moderator_badge = purple::Core::get_default()->get_badge_manager()->find("moderator");
+        }
+        result.member->get_badges()->add_badge(this->moderator_badge);
+        result.is_moderator = true;
+        if(!result.is_pinned) {
+            state.lru.erase(result.lru_position);
+            result.is_pinned = true;
+        }
+    }
+    return result;
+}
+
+// Records how long the message took from being published to now, by the server's clock
+static
+void record_delivery_latency(ConversationState& state, const PendingMessage& pending)
+{
+    if(pending.message->timestamp) {
+        gint64 server_now = g_get_real_time() + pending.batch->get_timestamps().clock_offset;
+        state.delivery_latency.record(server_now - pending.message->get_published_at());
+    }
+}
+
+void Connection::Impl::write_message(
+    purple::Account* account, ConversationState& state, const PendingMessage& pending, gint64 now)
+{
+    const ChatMessage& message = *pending.message;
+    record_delivery_latency(state, pending);
+    if(message.type == ChatMessage::Type::Deleted) {
+        // Deleted messages that have scrolled out of the history window are left as-is
+        if(auto* deleted_msg = state.messages.find(message.target_id.c_str())) {
+            (*deleted_msg)->set_contents("(Message deleted)");
+        }
+        return;
+    }
+    auto& author = get_member_state(account, state, message, now);
+    auto purple_msg = purple::Message::create(author.member, message.content.c_str());
+    purple_msg->set_timestamp(message.timestamp);
+    if(message.type == ChatMessage::Type::Ban) {
+        purple_msg->set_event(true);
+    } else if(message.type == ChatMessage::Type::Super) {
+        purple_msg->set_highlighted(true);
+    }
+    state.conversation->write_message(purple_msg);
+    state.messages.insert(message.id.c_str(), std::move(purple_msg));
+}
+
+void Connection::Impl::drop_stale_messages(const std::string& stream_url, ConversationState& state, gint64 now)
+{
+    auto& lane = state.pending.normal_lane;
+    gint64 cutoff = now - (gint64)this->max_delivery_lag * G_USEC_PER_SEC;
+    auto& pending = state.pending;
+    if(lane.empty() || lane.front().received_at >= cutoff) {
+        if(pending.is_behind) {
+            pending.is_behind = false;
+            g_message("%s caught up (%" G_GUINT64_FORMAT " messages skipped)",
+                      stream_url.c_str(), pending.dropped_count - pending.dropped_count_before);
+        }
+        return;
+    }
+    // Deletions are kept since the message they refer to may already be shown. Dropped messages
+    // still count toward the delivery latency (as of when they were given up on), so that falling
+    // behind far enough to drop them can't hide an SLO breach
+    auto dropped_count = std::erase_if(lane, [&state, cutoff](const PendingMessage& queued) {
+        if(queued.received_at >= cutoff || queued.message->type == ChatMessage::Type::Deleted) {
+            return false;
+        }
+        record_delivery_latency(state, queued);
+        return true;
+    });
+    if(!pending.is_behind) {
+        pending.is_behind = true;
+        pending.dropped_count_before = pending.dropped_count;
+        g_message("%s is more than %us behind; skipping ordinary messages until it catches up",
+                  stream_url.c_str(), this->max_delivery_lag);
+    }
+    pending.dropped_count += dropped_count;
+    g_debug("Dropped %zu messages from %s (%zu still queued)", dropped_count, stream_url.c_str(), pending.size());
+}
+
+/* Removes the least recently active members while the conversation has too many members or they
+   have been idle for too long. Removes at most EVICTION_BATCH_SIZE members per call so that
+   large member lists are trimmed gradually instead of all at once */
+void Connection::Impl::evict_members(ConversationState& state, gint64 now)
+{
+    auto* contact_manager = purple::Core::get_default()->get_contact_manager();
+    gint64 idle_cutoff = now - (gint64)this->member_idle_timeout * 60 * G_USEC_PER_SEC;
+    for(guint evicted_count = 0; evicted_count < EVICTION_BATCH_SIZE && !state.lru.empty(); ++evicted_count) {
+        auto member_state = state.members.find(*state.lru.front());
+        bool is_over_limit = state.members.size() > this->max_chat_members;
+        bool is_idle = this->member_idle_timeout > 0 && member_state->second.last_active < idle_cutoff;
+        if(!is_over_limit && !is_idle) {
+            break;
+        }
+        auto& contact = member_state->second.contact;
+        state.conversation->get_members()->remove_member(contact, /*announce=*/false, /*message=*/"");
+        if(member_state->second.owns_contact) {
+            // The same chatter may be participating in another of this account's conversations, in
+            // which case that conversation takes over removing the contact
+            MemberState* other_member = nullptr;
+            for(auto& [other_url, other_state] : this->conversations) {
+                auto other = other_state.members.find(member_state->first);
+                if(&other_state != &state && other != other_state.members.end()) {
+                    other_member = &other->second;
+                    break;
+                }
+            }
+            if(other_member) {
+                other_member->owns_contact = true;
+            } else {
+                contact_manager->remove(contact);
+            }
+        }
+        state.lru.pop_front();
+        state.members.erase(member_state);
+    }
+}
+
 void Connection::init(Class*)
 {
     m_impl = std::make_unique<Impl>();
@@ -73,6 +371,10 @@ peel::RefPtr<Connection> Connection::create(peel::RefPtr<purple::Account> accoun
 Connection::~Connection() noexcept
 {
     m_impl->cancellable->cancel();
+    if(m_impl->present_handler) {
+        auto* conversation_manager = purple::Core::get_default()->get_conversation_manager();
+        g_signal_handler_disconnect(conversation_manager, m_impl->present_handler);
+    }
 }
 
 void Connection::on_client_error(ChatClient*, const glib::Error* error)
@@ -101,47 +403,213 @@ void Connection::on_access_token_expiration_changed(ChatClient*, glib::DateTime*
     get_account()->get_settings()->set_string("access_token_expiration", expiration->format_iso8601());
 }
 
-void Connection::on_new_messages(ChatClient*, const char* stream_url, void* data)
+void Connection::Impl::update_priority(const char* stream_url, const ConversationState& state)
 {
-    using ConvType = purple::ConversationType;
+    auto priority = ChatPriority::Normal;
+    if(state.is_focused.has_value()) {
+        priority = *state.is_focused ? ChatPriority::Foreground : ChatPriority::Background;
+    }
+    if(state.unread_mentions > 0 && priority != ChatPriority::Foreground) {
+        // Someone is waiting on the user, so keep it more up to date than its neighbours
+        priority = (ChatPriority)((int)priority + 1);
+    }
+    if(this->client->get_chat_priority(stream_url) != priority) {
+        this->client->set_chat_priority(stream_url, priority);
+    }
+}
 
-    auto* account = get_account();
-    auto* core = purple::Core::get_default();
-    auto* contact_manager = core->get_contact_manager();
-    auto* conversation_manager = core->get_conversation_manager();
-    auto* badge_manager = core->get_badge_manager();
-    auto* messages = static_cast<peel::ArrayRef<const youtube::ChatMessage>*>(data);
-    // TODO: can technically avoid re-fetching/resetting display_name property since not likely to
-    //  change during course of a chat
-    peel::RefPtr conversation = conversation_manager->find(account, ConvType::CHANNEL, stream_url);
-    if(!conversation) {
+void Connection::set_chat_focused(const char* stream_url, bool is_focused)
+{
+    auto* state = m_impl->get_conversation_state(get_account(), stream_url);
+    if(!state || !m_impl->client->is_chat_connected(stream_url)) {
+        return;
+    }
+    state->is_focused = is_focused;
+    if(is_focused) {
+        state->unread_mentions = 0;
+    }
+    m_impl->update_priority(stream_url, *state);
+}
+
+// Purple only says when a conversation is brought to the front, so that is taken as the user moving
+// to it from whichever of this account's conversations they were looking at before
+void Connection::on_conversation_presented(purple::Conversation* conversation)
+{
+    const char* stream_url = conversation->get_topic();
+    if(conversation->get_account() != get_account() || !stream_url || !is_chat_connected(stream_url)) {
+        return;
+    }
+    std::vector<std::string> unfocused;
+    for(auto& [other_url, state] : m_impl->conversations) {
+        if(state.is_focused == true && other_url != stream_url) {
+            unfocused.push_back(other_url);
+        }
+    }
+    for(auto& other_url : unfocused) {
+        set_chat_focused(other_url.c_str(), false);
+    }
+    set_chat_focused(stream_url, true);
+}
+
+void Connection::on_chat_ended(ChatClient*, const char* stream_url)
+{
+    // Messages still waiting to be written are delivered as usual
+    auto* conversation_manager = purple::Core::get_default()->get_conversation_manager();
+    auto* conversation = conversation_manager->find(get_account(), purple::ConversationType::CHANNEL, stream_url);
+    if(conversation) {
+        conversation->set_online(false);
+    }
+}
+
+void Connection::on_new_messages(ChatClient*, const char* stream_url, MessageBatch* batch)
+{
+    if(!m_impl->eviction_source) {
+        m_impl->eviction_source = g_timeout_add_seconds(EVICTION_INTERVAL_SECONDS, [](gpointer data) -> gboolean {
+            auto* impl = static_cast<Connection::Impl*>(data);
+            auto now = g_get_monotonic_time();
+            for(auto& [stream_url, state] : impl->conversations) {
+                impl->evict_members(state, now);
+                if(state.unread_mentions > 0 && now >= state.mention_boost_until) {
+                    state.unread_mentions = 0;
+                    impl->update_priority(stream_url.c_str(), state);
+                }
+            }
+            return G_SOURCE_CONTINUE;
+        }, m_impl.get());
+    }
+    if(!m_impl->slo_source && m_impl->delivery_latency_slo > 0) {
+        m_impl->slo_source = g_timeout_add_seconds(DELIVERY_SLO_WINDOW_SECONDS, [](gpointer data) -> gboolean {
+            auto* self = static_cast<Connection*>(data);
+            for(auto& [stream_url, state] : self->m_impl->conversations) {
+                self->check_delivery_slo(stream_url, state);
+            }
+            return G_SOURCE_CONTINUE;
+        }, this);
+    }
+    auto* state = m_impl->get_conversation_state(get_account(), stream_url);
+    if(!state) {
         g_warning("Conversation doesn't exist for stream: %s", stream_url);
         return;
     }
-    for(const auto& message : *messages) {
-        auto contact = contact_manager->find_or_create(account, message.channel_id.c_str(), nullptr);
-        contact->set_display_name(message.display_name.c_str());
+    // Writing a large batch at once would block the UI, so queue the messages and write them in
+    // slices from an idle callback instead. The queue refers into the batch rather than copying it
+    auto now = g_get_monotonic_time();
+    peel::RefPtr<MessageBatch> batch_ref{batch};
+    // The account's handle (e.g. "@name"), which is how other chatters mention it
+    const char* own_handle = get_account()->get_contact_info()->get_display_name();
+    guint mention_count = 0;
+    for(const auto& message : *batch) {
+        bool is_mention = message.type == ChatMessage::Type::Text && own_handle && *own_handle
+            && message.content && strstr(message.content.c_str(), own_handle);
+        mention_count += is_mention;
+        // Deletions stay in order with the messages they refer to, which may still be queued in the
+        // normal lane. (For a deletion, is_moderator describes the moderator who deleted the message)
+        bool is_priority = message.type != ChatMessage::Type::Deleted
+            && (message.is_moderator || is_mention
+                || message.type == ChatMessage::Type::Super
+                || message.type == ChatMessage::Type::Ban);
+        auto& lane = is_priority ? state->pending.priority_lane : state->pending.normal_lane;
+        lane.push_back({batch_ref, &message, now});
+    }
+    if(mention_count > 0 && state->is_focused != true) {
+        bool had_mentions = state->unread_mentions > 0;
+        state->unread_mentions += mention_count;
+        state->mention_boost_until = now + MENTION_BOOST_DURATION;
+        if(!had_mentions) {
+            m_impl->update_priority(stream_url, *state);
+        }
+    }
+    if(!m_impl->delivery_source) {
+        m_impl->delivery_source = g_idle_add_full(G_PRIORITY_DEFAULT_IDLE, [](gpointer data) -> gboolean {
+            auto* self = static_cast<Connection*>(data);
+            if(self->deliver_pending_messages()) {
+                return G_SOURCE_CONTINUE;
+            }
+            self->m_impl->delivery_source.release();
+            return G_SOURCE_REMOVE;
+        }, this, nullptr);
+    }
+}
 
-        auto author = conversation->get_members()->find_or_add_member(
-            contact, /*announce=*/false, /*message=*/"");
-        if(message.is_moderator) {
-            author->get_badges()->add_badge(badge_manager->find("moderator"));
+/* Writes queued messages until they run out or the time budget for this main loop iteration is
+   used up. Conversations take turns so that a busy chat can't starve the others. Returns true if
+   there are still messages left to write */
+bool Connection::deliver_pending_messages()
+{
+    auto* account = get_account();
+    auto now = g_get_monotonic_time();
+    auto deadline = now + DELIVERY_SLICE_BUDGET;
+    for(auto& [stream_url, state] : m_impl->conversations) {
+        m_impl->drop_stale_messages(stream_url, state, now);
+        if(state.members.size() > m_impl->max_chat_members) {
+            m_impl->evict_members(state, now);
         }
-        auto purple_msg = purple::Message::create(author, message.content.c_str());
-        purple_msg->set_timestamp(message.timestamp);
-        if(message.type == ChatMessage::Type::Ban) {
-            purple_msg->set_event(true);
-        } else if(message.type == ChatMessage::Type::Super) {
-            purple_msg->set_highlighted(true);
+    }
+
+    for(auto lane : {&DeliveryQueue::priority_lane, &DeliveryQueue::normal_lane}) {
+        bool wrote_message = true;
+        while(wrote_message) {
+            wrote_message = false;
+            for(auto& [_, state] : m_impl->conversations) {
+                auto& queue = state.pending.*lane;
+                if(queue.empty()) {
+                    continue;
+                }
+                m_impl->write_message(account, state, queue.front(), now);
+                queue.pop_front();
+                wrote_message = true;
+                if(g_get_monotonic_time() >= deadline) {
+                    return std::ranges::any_of(m_impl->conversations, [](const auto& entry) {
+                        return !entry.second.pending.empty();
+                    });
+                }
+            }
         }
-        conversation->write_message(purple_msg);
     }
+    return false;
+}
+
+/* Checks the p95 delivery latency of the messages written since the last check against the SLO.
+   Emits delivery-slo-breached when the conversation goes over it */
+void Connection::check_delivery_slo(const std::string& stream_url, ConversationState& state)
+{
+    auto current = state.delivery_latency.snapshot();
+    auto window = current.since(state.slo_window_start);
+    state.slo_window_start = current;
+    if(window.total < DELIVERY_SLO_MIN_SAMPLES) {
+        return;
+    }
+    auto p95_ms = (guint)(window.get_percentile(0.95) / 1000);
+    bool is_breached = p95_ms > m_impl->delivery_latency_slo * 1000;
+    if(is_breached == state.is_slo_breached) {
+        return;
+    }
+    state.is_slo_breached = is_breached;
+    if(!is_breached) {
+        g_message("Delivery latency for %s is back within %us (p95 %ums)",
+                  stream_url.c_str(), m_impl->delivery_latency_slo, p95_ms);
+        return;
+    }
+    g_warning("Delivery latency for %s is over %us (p95 %ums over %" G_GUINT64_FORMAT " messages)",
+              stream_url.c_str(), m_impl->delivery_latency_slo, p95_ms, window.total);
+    sig_delivery_slo_breached.emit(this, stream_url.c_str(), p95_ms);
 }
 
 Task<void> Connection::vfunc_connect_async(gio::Cancellable* cancellable)
 {
     auto* account = this->get_account();
     auto* settings = account->get_settings();
+    m_impl->message_history_depth = get_uint_setting(
+        settings, "message_history_depth", DEFAULT_MESSAGE_HISTORY_DEPTH);
+    m_impl->max_delivery_lag = get_uint_setting(settings, "max_delivery_lag", DEFAULT_MAX_DELIVERY_LAG);
+    m_impl->max_chat_members = get_uint_setting(settings, "max_chat_members", DEFAULT_MAX_CHAT_MEMBERS);
+    m_impl->member_idle_timeout = get_uint_setting(
+        settings, "member_idle_timeout", DEFAULT_MEMBER_IDLE_TIMEOUT);
+    m_impl->delivery_latency_slo = get_uint_setting(
+        settings, "delivery_latency_slo", DEFAULT_DELIVERY_LATENCY_SLO);
+    // The TLS handshake with the API server can happen while we wait on the credential manager (and
+    // is done by the time the account is ready and the first chat is joined)
+    ChatClient::preconnect();
     if(!m_impl->client) {
         auto* credential_manager = purple::Core::get_default()->get_credential_manager();
         AsyncResult result;
@@ -156,6 +624,7 @@ Task<void> Connection::vfunc_connect_async(gio::Cancellable* cancellable)
         if(error) {
             co_return error;
         }
+        bool use_worker_thread = get_bool_setting(settings, "network_thread", false);
         const char* access_token_expiration_str = settings->get_string("access_token_expiration", "");
         auto access_token_expiration = glib::DateTime::create_from_iso8601(access_token_expiration_str, nullptr);
         if(credentials_str && access_token_expiration) {
@@ -168,10 +637,10 @@ Task<void> Connection::vfunc_connect_async(gio::Cancellable* cancellable)
             peel::String& access_token = credentials->first;
             peel::String& refresh_token = credentials->second;
             m_impl->client = ChatClient::create_authorized(
-                ci, cs, access_token.c_str(), refresh_token.c_str(), access_token_expiration);
+                ci, cs, access_token.c_str(), refresh_token.c_str(), access_token_expiration, use_worker_thread);
         } else {
             // No existing credentials - will authorize in next step
-            m_impl->client = ChatClient::create(ci, cs);
+            m_impl->client = ChatClient::create(ci, cs, use_worker_thread);
         }
 
         // Setup signals
@@ -180,10 +649,24 @@ Task<void> Connection::vfunc_connect_async(gio::Cancellable* cancellable)
         m_impl->client->connect_access_token_expiration_changed(
              this, &Connection::on_access_token_expiration_changed);
         m_impl->client->connect_new_messages(this, &Connection::on_new_messages);
+        m_impl->client->connect_chat_ended(this, &Connection::on_chat_ended);
+        m_impl->client->connect_metrics_updated(this, &Connection::on_metrics_updated);
+        auto* conversation_manager = purple::Core::get_default()->get_conversation_manager();
+        m_impl->present_handler = g_signal_connect(conversation_manager, "present-conversation",
+            G_CALLBACK(+[](PurpleConversationManager*, PurpleConversation* conversation, gpointer data) {
+                static_cast<Connection*>(data)->on_conversation_presented(
+                    reinterpret_cast<purple::Conversation*>(conversation));
+            }), this);
     }
+    m_impl->client->set_watch_upcoming(get_bool_setting(settings, "watch_upcoming", true));
+    m_impl->client->set_background_poll_multiplier(
+        get_uint_setting(settings, "background_poll_multiplier", DEFAULT_BACKGROUND_POLL_MULTIPLIER));
+    m_impl->client->set_metrics_interval(
+        get_uint_setting(settings, "metrics_interval", DEFAULT_METRICS_INTERVAL) * 1000);
 
     // Authorize client if needed
-    if(!m_impl->client->is_authorized()) {
+    bool is_new_authorization = !m_impl->client->is_authorized();
+    if(is_new_authorization) {
         peel::UniquePtr<glib::Error> error;
         auto url = m_impl->client->generate_auth_url();
         if(!url.has_value()) {
@@ -207,17 +690,105 @@ Task<void> Connection::vfunc_connect_async(gio::Cancellable* cancellable)
         }
     }
 
-    auto display_name = co_await m_impl->client->get_user_display_name(cancellable);
-    if(!display_name.has_value()) {
-        account->disconnect_with_error("Failed to get account display name", display_name.error().get());
-        co_return std::move(display_name.error());
+    const char* cached_display_name = settings->get_string("cached_display_name", "");
+    const char* cached_channel_id = settings->get_string("cached_channel_id", "");
+    // A new authorization may be for a different channel than the one cached
+    if(!is_new_authorization && cached_display_name && *cached_display_name
+       && cached_channel_id && *cached_channel_id) {
+        // The identity rarely changes, so report ready right away using the one from last time and
+        // check it (and rejoin the channels left open from the previous session) in the background
+        account->get_contact_info()->set_display_name(cached_display_name);
+        m_impl->own_channel_id = cached_channel_id;
+        account->ready();
+        [](peel::RefPtr<Connection> self) -> VoidTask {
+            gio::Cancellable* cancellable = self->m_impl->cancellable;
+            co_await when_all(self->revalidate_identity_async(cancellable),
+                              self->rejoin_conversations_async(cancellable));
+        }(peel::RefPtr<Connection>{this}).start();
+        co_return {};
     }
-    account->get_contact_info()->set_display_name(std::move(*display_name));
+
+    // Restoring the channels left open from a previous session doesn't depend on who we are, so it
+    // runs in the background while the identity is looked up (and after the account is ready)
+    [](peel::RefPtr<Connection> self) -> VoidTask {
+        co_await self->rejoin_conversations_async(self->m_impl->cancellable);
+    }(peel::RefPtr<Connection>{this}).start();
+    auto identity = co_await m_impl->client->get_user_identity(cancellable);
+    if(!identity.has_value()) {
+        account->disconnect_with_error("Failed to get account display name", identity.error().get());
+        co_return std::move(identity.error());
+    }
+    set_identity(std::move(*identity));
 
     account->ready();
     co_return {};
 }
 
+Task<void> Connection::revalidate_identity_async(gio::Cancellable* cancellable)
+{
+    auto identity = co_await m_impl->client->get_user_identity(cancellable);
+    if(!identity.has_value()) {
+        auto& error = identity.error();
+        if(error->domain == YOUTUBE_CHAT_ERROR && error->code == YOUTUBE_CHAT_ERROR_UNAUTHORIZED) {
+            // Every request would fail the same way, so don't leave the account looking connected
+            this->get_account()->disconnect_with_error("Account authorization is no longer valid", error.get());
+            co_return std::move(error);
+        }
+        // Most likely a network problem. Keep using the cached identity; it will be checked again
+        // on the next connect
+        g_warning("Failed to revalidate account identity: %s", error->message);
+        co_return std::move(error);
+    }
+    set_identity(std::move(*identity));
+    co_return {};
+}
+
+void Connection::set_identity(ChannelIdentity identity)
+{
+    auto* account = this->get_account();
+    auto* settings = account->get_settings();
+    if(g_strcmp0(settings->get_string("cached_display_name", ""), identity.display_name.c_str()) != 0) {
+        settings->set_string("cached_display_name", identity.display_name);
+    }
+    if(g_strcmp0(settings->get_string("cached_channel_id", ""), identity.channel_id.c_str()) != 0) {
+        settings->set_string("cached_channel_id", identity.channel_id);
+    }
+    account->get_contact_info()->set_display_name(std::move(identity.display_name));
+    m_impl->own_channel_id = std::move(identity.channel_id);
+}
+
+Task<void> Connection::rejoin_conversations_async(gio::Cancellable* cancellable)
+{
+    auto* account = this->get_account();
+    auto* conversation_manager = purple::Core::get_default()->get_conversation_manager();
+    std::vector<peel::RefPtr<purple::Conversation>> conversations;
+    GList* all_conversations = purple_conversation_manager_get_all(
+        reinterpret_cast<PurpleConversationManager*>(conversation_manager));
+    for(GList* item = all_conversations; item; item = item->next) {
+        auto* conversation = reinterpret_cast<purple::Conversation*>(item->data);
+        const char* stream_url = conversation->get_topic();
+        if(conversation->get_account() == account && stream_url && !is_chat_connected(stream_url)) {
+            conversations.push_back(peel::RefPtr<purple::Conversation>{conversation});
+        }
+    }
+    g_list_free(all_conversations);
+
+    auto results = co_await when_all(conversations.size(), [&](std::size_t i) {
+        return connect_to_chat_async(conversations[i]->get_topic(), cancellable);
+    });
+    for(std::size_t i = 0; i < results.size(); ++i) {
+        auto& conversation = conversations[i];
+        if(!results[i].has_value()) {
+            // Leave it offline; the user can still rejoin it by hand
+            g_warning("Failed to rejoin %s: %s", conversation->get_topic(), results[i].error()->message);
+            continue;
+        }
+        conversation->set_online(true);
+        conversation->set_title(get_title(conversation->get_topic()));
+    }
+    co_return {};
+}
+
 Task<void> Connection::vfunc_disconnect_async(const char*, gio::Cancellable*)
 {
     m_impl->client->disconnect();
@@ -226,12 +797,22 @@ Task<void> Connection::vfunc_disconnect_async(const char*, gio::Cancellable*)
 
 Task<void> Connection::connect_to_chat_async(const char* stream_url, gio::Cancellable* cancellable)
 {
+    // The Purple conversation may have been recreated since we last joined, so don't reuse
+    // any cached objects from a previous session
+    if(auto state = m_impl->conversations.find(std::string_view{stream_url});
+       state != m_impl->conversations.end()) {
+        m_impl->conversations.erase(state);
+    }
     return m_impl->client->connect_to_chat_async(stream_url, cancellable);
 }
 
 void Connection::disconnect_chat(const char* stream_url)
 {
     m_impl->client->disconnect_chat(stream_url);
+    if(auto state = m_impl->conversations.find(std::string_view{stream_url});
+       state != m_impl->conversations.end()) {
+        m_impl->conversations.erase(state);
+    }
 }
 
 Task<void> Connection::send_message_async(const char* stream_url, const char* message, gio::Cancellable* cancellable)
@@ -249,8 +830,41 @@ bool Connection::is_chat_connected(const char* stream_url)
     return m_impl->client->is_chat_connected(stream_url);
 }
 
+std::size_t Connection::get_delivery_backlog(const char* stream_url) const
+{
+    auto state = m_impl->conversations.find(std::string_view{stream_url});
+    if(state == m_impl->conversations.end()) {
+        return 0;
+    }
+    return state->second.pending.size();
+}
+
+LatencyHistogram::Snapshot Connection::get_delivery_latency(const char* stream_url) const
+{
+    auto state = m_impl->conversations.find(std::string_view{stream_url});
+    if(state == m_impl->conversations.end()) {
+        return {};
+    }
+    return state->second.delivery_latency.snapshot();
+}
+
+ClientMetrics Connection::get_metrics() const
+{
+    if(!m_impl->client) {
+        return {};
+    }
+    return m_impl->client->get_metrics();
+}
+
+void Connection::on_metrics_updated(ChatClient*)
+{
+    sig_metrics_updated.emit(this);
+}
+
 void Connection::Class::init()
 {
+    sig_delivery_slo_breached = decltype(sig_delivery_slo_breached)::create("delivery-slo-breached");
+    sig_metrics_updated = decltype(sig_metrics_updated)::create("metrics-updated");
     auto* klass = reinterpret_cast<PurpleConnectionClass*>(this);
     klass->connect_async = [](PurpleConnection* connection, GCancellable* cancellable,
                               GAsyncReadyCallback callback, gpointer data) {
@@ -327,3 +941,34 @@ extract_access_and_refresh_tokens(const char* credentials)
     std::span<const uint8_t> refresh_token_base64{delimiter + 1, credentials_view.end()};
     return std::make_pair(decode_base64(access_token_base64), decode_base64(refresh_token_base64));
 }
+
+static
+guint get_uint_setting(purple::AccountSettings* settings, const char* name, guint default_value)
+{
+    const char* value_str = settings->get_string(name, "");
+    if(!value_str || !*value_str) {
+        return default_value;
+    }
+    guint64 value;
+    if(!g_ascii_string_to_unsigned(value_str, 10, 0, G_MAXUINT, &value, nullptr)) {
+        g_warning("Invalid value for account setting '%s': %s", name, value_str);
+        return default_value;
+    }
+    return (guint)value;
+}
+
+static
+bool get_bool_setting(purple::AccountSettings* settings, const char* name, bool default_value)
+{
+    const char* value_str = settings->get_string(name, "");
+    if(!value_str || !*value_str) {
+        return default_value;
+    }
+    if(g_ascii_strcasecmp(value_str, "true") == 0 || g_ascii_strcasecmp(value_str, "yes") == 0) {
+        return true;
+    } else if(g_ascii_strcasecmp(value_str, "false") == 0 || g_ascii_strcasecmp(value_str, "no") == 0) {
+        return false;
+    }
+    g_warning("Invalid value for account setting '%s': %s", name, value_str);
+    return default_value;
+}
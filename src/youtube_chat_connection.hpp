@@ -18,9 +18,11 @@ along with this program.  If not, see <https://www.gnu.org/licenses/>.
 #pragma once
 
 #include <memory>
+#include <string>
 #include <peel/class.h>
 #include <peel/String.h>
 #include <peel/RefPtr.h>
+#include <peel/signal.h>
 #include <peel/UniquePtr.h>
 #include <peel/GLib/Error.h>
 #include <peel/Purple/Connection.h>
@@ -32,9 +34,15 @@ namespace peel::GLib {
 class DateTime;
 } // namespace peel::GLib
 
+namespace peel::Purple {
+class Conversation;
+} // namespace peel::Purple
+
 namespace youtube {
 
 class ChatClient;
+class MessageBatch;
+struct ConversationState;
 
 /* Represents a YouTube Live Chat connection */
 class Connection final : public purple::Connection {
@@ -52,13 +60,45 @@ public:
 
     peel::String get_title(const char* stream_url);
     bool is_chat_connected(const char* stream_url);
+    // Number of received messages that have not been written to the Purple conversation yet
+    std::size_t get_delivery_backlog(const char* stream_url) const;
+    // Time from each message being published to it being written to the Purple conversation, for
+    // the messages written since the chat was joined
+    LatencyHistogram::Snapshot get_delivery_latency(const char* stream_url) const;
+    // For the UI to report which conversations the user is looking at. Those are polled most eagerly,
+    // and the rest less often (unless they mention the user). If never called, all conversations
+    // are polled normally. Called automatically when Purple presents one of the conversations
+    void set_chat_focused(const char* stream_url, bool is_focused);
+    // Metrics of the underlying client; see ChatClient::get_metrics()
+    ClientMetrics get_metrics() const;
+
+    PEEL_SIGNAL_CONNECT_METHOD(delivery_slo_breached, sig_delivery_slo_breached)
+    PEEL_SIGNAL_CONNECT_METHOD(metrics_updated, sig_metrics_updated)
 private:
     struct Impl;
 
+    bool deliver_pending_messages();
+    void check_delivery_slo(const std::string& stream_url, ConversationState&);
+    // Reconnects to all of this account's channel conversations that are not currently connected
+    Task<void> rejoin_conversations_async(gio::Cancellable*);
+    // Looks up the account's identity and updates the cached copy if it changed
+    Task<void> revalidate_identity_async(gio::Cancellable*);
+    void set_identity(ChannelIdentity);
+
     void on_client_error(ChatClient*, const glib::Error*);
     void on_tokens_changed(ChatClient*, const char* access_token, const char* refresh_token);
     void on_access_token_expiration_changed(ChatClient*, glib::DateTime*);
-    void on_new_messages(ChatClient*, const char* stream_url, void* data);
+    void on_new_messages(ChatClient*, const char* stream_url, MessageBatch*);
+    void on_chat_ended(ChatClient*, const char* stream_url);
+    void on_conversation_presented(purple::Conversation*);
+    void on_metrics_updated(ChatClient*);
+
+    // The conversation's p95 delivery latency (in milliseconds) went over the delivery_latency_slo
+    // setting. Emitted again only after it has recovered and then gone over once more
+    inline static peel::Signal<Connection, void(const char* stream_url, guint p95_ms)> sig_delivery_slo_breached;
+    // Emitted every metrics_interval seconds (per the account setting), when get_metrics() is worth
+    // calling again
+    inline static peel::Signal<Connection, void()> sig_metrics_updated;
 
     std::unique_ptr<Impl> m_impl;
 };
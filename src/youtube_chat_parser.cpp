@@ -17,20 +17,16 @@ along with this program.  If not, see <https://www.gnu.org/licenses/>.
 */
 #include "youtube_chat_parser.hpp"
 #include <algorithm>
+#include <array>
 #include <optional>
 #include <string_view>
 #include <utility>
 #include <peel/Json/Json.h>
-#include <peel/Json/Builder.h>
 #include <peel/Json/Parser.h>
 #include <peel/Json/Node.h>
 #include <peel/Json/Path.h>
 #include <peel/GLib/functions.h>
 #include <peel/GLib/DateTime.h>
-#include <peel/GLib/HashTable.h>
-#include <peel/GLib/Uri.h>
-#include <peel/GLib/UriFlags.h>
-#include <peel/GLib/UriParamsFlags.h>
 
 using namespace std::string_view_literals;
 
@@ -43,6 +39,8 @@ static constexpr struct SupportedMsg {
     {"textMessageEvent"sv, ChatMessage::Type::Text},
     {"superChatEvent"sv,   ChatMessage::Type::Super},
     {"userBannedEvent"sv,  ChatMessage::Type::Ban},
+    {"messageDeletedEvent"sv,   ChatMessage::Type::Deleted},
+    {"messageRetractedEvent"sv, ChatMessage::Type::Deleted},
 };
 
 static
@@ -56,23 +54,115 @@ static std::optional<guint> match_json_uint(json::Node* root, const char* path);
 static std::optional<bool> match_json_bool(json::Node* root, const char* path);
 static peel::RefPtr<glib::DateTime> match_json_date(json::Node* root, const char* path);
 
-std::expected<peel::String, ErrorPtr> extract_video_id(const char* stream_url)
+static
+bool is_id_char(char c)
 {
-    peel::UniquePtr<glib::Error> error;
-    auto stream_uri = glib::Uri::parse(stream_url, glib::UriFlags::NONE, &error);
-    if(error) {
-        return std::unexpected(std::move(error));
+    return g_ascii_isalnum(c) || c == '-' || c == '_' || c == '.';
+}
+
+// Splits off (and returns) everything up to the first of `separators`
+static
+std::string_view take_until(std::string_view& str, std::string_view separators)
+{
+    std::size_t end = std::min(str.find_first_of(separators), str.size());
+    std::string_view taken = str.substr(0, end);
+    str.remove_prefix(end);
+    return taken;
+}
+
+static
+bool is_valid_id(std::string_view id)
+{
+    return !id.empty() && std::ranges::all_of(id, is_id_char);
+}
+
+static
+std::string_view find_query_param(std::string_view query, std::string_view name)
+{
+    while(!query.empty()) {
+        std::string_view param = take_until(query, "&");
+        if(!query.empty()) {
+            query.remove_prefix(1);
+        }
+        if(param.size() > name.size() && param.starts_with(name) && param[name.size()] == '=') {
+            return param.substr(name.size() + 1);
+        }
     }
-    const char* query = stream_uri->get_query();
-    auto params = glib::Uri::parse_params(query, strlen(query), "&", glib::UriParamsFlags::NONE, &error);
-    if(error) {
-        return std::unexpected(std::move(error));
+    return {};
+}
+
+std::expected<StreamUrlTarget, ErrorPtr> parse_stream_url(std::string_view stream_url)
+{
+    using Kind = StreamUrlTarget::Kind;
+    auto unsupported = [&] {
+        return std::unexpected(ErrorPtr(YOUTUBE_CHAT_ERROR, 1, "Unsupported stream URL: %.*s",
+                                        (int)stream_url.size(), stream_url.data()));
+    };
+
+    std::string_view rest = stream_url;
+    for(std::string_view scheme : {"https://", "http://"}) {
+        if(rest.starts_with(scheme)) {
+            rest.remove_prefix(scheme.size());
+            break;
+        }
     }
-    auto* video_id = (const char*)glib::HashTable::lookup(params, "v");
-    if(!video_id) {
-        return std::unexpected(glib::Error::create(YOUTUBE_CHAT_ERROR, 1, "Missing parameter in video URL"));
+    std::string_view host = take_until(rest, "/?#");
+    for(std::string_view subdomain : {"www.", "m."}) {
+        if(host.starts_with(subdomain)) {
+            host.remove_prefix(subdomain.size());
+            break;
+        }
     }
-    return video_id;
+    std::string_view path = take_until(rest, "?#");
+    std::string_view query;
+    if(rest.starts_with('?')) {
+        rest.remove_prefix(1);
+        query = take_until(rest, "#");
+    }
+    if(path.starts_with('/')) {
+        path.remove_prefix(1);
+    }
+    // Path segments, e.g. "watch", or "@handle" and "live"
+    std::array<std::string_view, 3> segments;
+    for(auto& segment : segments) {
+        segment = take_until(path, "/");
+        if(path.starts_with('/')) {
+            path.remove_prefix(1);
+        }
+    }
+    auto [first, second, third] = segments;
+
+    if(host == "youtu.be") {
+        if(!is_valid_id(first)) {
+            return unsupported();
+        }
+        return StreamUrlTarget{Kind::Video, first};
+    }
+    if(host != "youtube.com") {
+        return unsupported();
+    }
+    if(first == "watch") {
+        std::string_view video_id = find_query_param(query, "v");
+        if(!is_valid_id(video_id)) {
+            return std::unexpected(ErrorPtr(YOUTUBE_CHAT_ERROR, 1, "Missing parameter in video URL"));
+        }
+        return StreamUrlTarget{Kind::Video, video_id};
+    }
+    if(first == "live" || first == "shorts" || first == "embed") {
+        if(!is_valid_id(second)) {
+            return unsupported();
+        }
+        return StreamUrlTarget{Kind::Video, second};
+    }
+    // A channel's page or its /live page both mean whatever it is streaming right now
+    bool is_channel_page = second.empty() || second == "live" || second == "streams";
+    if(first.starts_with('@') && is_valid_id(first.substr(1)) && is_channel_page) {
+        return StreamUrlTarget{Kind::Handle, first.substr(1)};
+    }
+    if(first == "channel" && is_valid_id(second) && (third.empty() || third == "live" || third == "streams")) {
+        return StreamUrlTarget{Kind::Channel, second};
+    }
+    return unsupported();
 }
 
 std::expected<StreamInfo, ErrorPtr> parse_stream_info(peel::ArrayRef<const char> response)
@@ -87,15 +177,29 @@ std::expected<StreamInfo, ErrorPtr> parse_stream_info(peel::ArrayRef<const char>
     if(!title) {
         return std::unexpected(ErrorPtr(YOUTUBE_CHAT_ERROR, 1, "Missing live stream title"));
     }
-    // Get stream live chat ID
+    // Finished broadcasts keep their scheduled start time, so they would otherwise look upcoming
+    if(match_json_string(*root, "$.items[*].liveStreamingDetails.actualEndTime")) {
+        return std::unexpected(ErrorPtr(YOUTUBE_CHAT_ERROR, YOUTUBE_CHAT_ERROR_CHAT_ENDED, "Live stream has ended"));
+    }
+    // Get stream live chat ID. Upcoming broadcasts don't have one yet, but do have a start time
     auto live_chat_id = match_json_string(*root, "$.items[*].liveStreamingDetails.activeLiveChatId");
-    if(!live_chat_id) {
+    auto scheduled_start_time = match_json_date(*root, "$.items[*].liveStreamingDetails.scheduledStartTime");
+    if(!live_chat_id && !scheduled_start_time) {
         return std::unexpected(ErrorPtr(YOUTUBE_CHAT_ERROR, 1, "Missing live chat ID"));
     }
-    return StreamInfo{std::move(title), std::move(live_chat_id)};
+    return StreamInfo{std::move(title), std::move(live_chat_id), std::move(scheduled_start_time)};
 }
 
-std::expected<peel::String, ErrorPtr> parse_display_name(peel::ArrayRef<const char> response)
+peel::String parse_error_reason(peel::ArrayRef<const char> response)
+{
+    auto root = parse_json(response);
+    if(!root.has_value()) {
+        return nullptr;
+    }
+    return match_json_string(*root, "$.error.errors[0].reason");
+}
+
+std::expected<ChannelIdentity, ErrorPtr> parse_channel_identity(peel::ArrayRef<const char> response)
 {
     auto root = parse_json(response);
     if(!root.has_value()) {
@@ -108,7 +212,37 @@ std::expected<peel::String, ErrorPtr> parse_display_name(peel::ArrayRef<const ch
     if(!display_name) {
         return std::unexpected(ErrorPtr(YOUTUBE_CHAT_ERROR, 1, "Missing channel handle"));
     }
-    return display_name;
+    auto channel_id = match_json_string(*root, "$.items[*].id");
+    if(!channel_id) {
+        return std::unexpected(ErrorPtr(YOUTUBE_CHAT_ERROR, 1, "Missing channel ID"));
+    }
+    return ChannelIdentity{std::move(display_name), std::move(channel_id)};
+}
+
+std::expected<peel::String, ErrorPtr> parse_channel_id(peel::ArrayRef<const char> response)
+{
+    auto root = parse_json(response);
+    if(!root.has_value()) {
+        return std::unexpected(std::move(root.error()));
+    }
+    auto channel_id = match_json_string(*root, "$.items[*].id");
+    if(!channel_id) {
+        return std::unexpected(ErrorPtr(YOUTUBE_CHAT_ERROR, 1, "Channel not found"));
+    }
+    return channel_id;
+}
+
+std::expected<peel::String, ErrorPtr> parse_search_video_id(peel::ArrayRef<const char> response)
+{
+    auto root = parse_json(response);
+    if(!root.has_value()) {
+        return std::unexpected(std::move(root.error()));
+    }
+    auto video_id = match_json_string(*root, "$.items[*].id.videoId");
+    if(!video_id) {
+        return std::unexpected(ErrorPtr(YOUTUBE_CHAT_ERROR, 1, "Channel is not streaming right now"));
+    }
+    return video_id;
 }
 
 std::expected<ResponseInfo, ErrorPtr> parse_chat_messages(peel::ArrayRef<const char> response)
@@ -122,9 +256,11 @@ std::expected<ResponseInfo, ErrorPtr> parse_chat_messages(peel::ArrayRef<const c
     if(!poll_interval.has_value()) {
         return std::unexpected(ErrorPtr(YOUTUBE_CHAT_ERROR, 1, "Invalid polling interval"));
     }
+    // Only present once the chat has ended
+    auto offline_at = match_json_date(*root, "$.offlineAt");
     // Get the page token to sent in the next request
     auto next_page_token = match_json_string(*root, "$.nextPageToken");
-    if(!next_page_token) {
+    if(!next_page_token && !offline_at) {
         return std::unexpected(ErrorPtr(YOUTUBE_CHAT_ERROR, 1, "Missing nextPageToken"));
     }
     // Process the batch of chat messages we have received
@@ -135,6 +271,7 @@ std::expected<ResponseInfo, ErrorPtr> parse_chat_messages(peel::ArrayRef<const c
     ResponseInfo result;
     result.poll_interval = poll_interval.value();
     result.next_page_token = next_page_token;
+    result.offline_at = std::move(offline_at);
     auto item_count = items->get_length();
     result.messages.reserve(item_count);
     for(guint i = 0; i < item_count; ++i) {
@@ -146,25 +283,52 @@ std::expected<ResponseInfo, ErrorPtr> parse_chat_messages(peel::ArrayRef<const c
     return result;
 }
 
-peel::String create_text_message(const char* live_chat_id, const char* message)
+static
+void append_json_string(GString* out, const char* str)
+{
+    g_string_append_c(out, '"');
+    for(const char* c = str; *c; ++c) {
+        switch(*c) {
+        case '"':  g_string_append(out, "\\\""); break;
+        case '\\': g_string_append(out, "\\\\"); break;
+        case '\n': g_string_append(out, "\\n"); break;
+        case '\r': g_string_append(out, "\\r"); break;
+        case '\t': g_string_append(out, "\\t"); break;
+        default:
+            if((unsigned char)*c < 0x20) {
+                g_string_append_printf(out, "\\u%04x", (unsigned)*c);
+            } else {
+                // Anything else (including UTF-8 sequences) can be copied as-is
+                g_string_append_c(out, *c);
+            }
+        }
+    }
+    g_string_append_c(out, '"');
+}
+
+void write_text_message(GString* out, const char* live_chat_id, const char* message)
 {
-    auto builder = json::Builder::create_immutable();
-    builder->begin_object();
-        builder->set_member_name("snippet");
-        builder->begin_object();
-            builder->set_member_name("liveChatId");
-            builder->add_string_value(live_chat_id);
-            builder->set_member_name("type");
-            builder->add_string_value("textMessageEvent");
-            builder->set_member_name("textMessageDetails");
-            builder->begin_object();
-                builder->set_member_name("messageText");
-                builder->add_string_value(message);
-            builder->end_object();
-        builder->end_object();
-    builder->end_object();
-    auto root = builder->get_root();
-    return json::to_string(root, /*pretty=*/true);
+    g_string_truncate(out, 0);
+    g_string_append(out, "{\"snippet\":{\"liveChatId\":");
+    append_json_string(out, live_chat_id);
+    g_string_append(out, ",\"type\":\"textMessageEvent\",\"textMessageDetails\":{\"messageText\":");
+    append_json_string(out, message);
+    g_string_append(out, "}}}");
+}
+
+void write_ban_request(GString* out, const char* live_chat_id, const char* channel_id, guint duration_seconds)
+{
+    g_string_truncate(out, 0);
+    g_string_append(out, "{\"snippet\":{\"liveChatId\":");
+    append_json_string(out, live_chat_id);
+    if(duration_seconds > 0) {
+        g_string_append_printf(out, ",\"type\":\"temporary\",\"banDurationSeconds\":%u", duration_seconds);
+    } else {
+        g_string_append(out, ",\"type\":\"permanent\"");
+    }
+    g_string_append(out, ",\"bannedUserDetails\":{\"channelId\":");
+    append_json_string(out, channel_id);
+    g_string_append(out, "}}}");
 }
 
 static
@@ -184,6 +348,12 @@ std::optional<ChatMessage> parse_chat_message(json::Node* item)
     }
 
     // These fields should be present for all supported message types
+    //  Get message ID
+    message.id = match_json_string(item, "$.id");
+    if(!message.id) {
+        g_warning("Message of type '%s' was missing an ID", message_type_name.c_str());
+        return {};
+    }
     //  Get timestamp
     message.timestamp = match_json_date(item, "$.snippet.publishedAt");
     if(!message.timestamp) {
@@ -218,6 +388,16 @@ std::optional<ChatMessage> parse_chat_message(json::Node* item)
         }
         message.content = glib::strdup_printf(
             "%s was banned (Ban Type: %s)", banned_display_name.c_str(), ban_type.c_str());
+    } else if(message_type->type == ChatMessage::Type::Deleted) {
+        // Moderator deletions and author retractions only differ in where the target ID is stored
+        message.target_id = match_json_string(item, "$.snippet.messageDeletedDetails.deletedMessageId");
+        if(!message.target_id) {
+            message.target_id = match_json_string(item, "$.snippet.messageRetractedDetails.retractedMessageId");
+        }
+        if(!message.target_id) {
+            g_warning("Message of type '%s' was missing the deleted message's ID", message_type_name.c_str());
+            return {};
+        }
     } else {
         message.content = match_json_string(item, "$.snippet.displayMessage");
         if(!message.content) {
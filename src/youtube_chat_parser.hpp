@@ -19,6 +19,7 @@ along with this program.  If not, see <https://www.gnu.org/licenses/>.
 
 #include <vector>
 #include <expected>
+#include <string_view>
 #include <peel/GLib/Error.h>
 #include <peel/String.h>
 #include <peel/UniquePtr.h>
@@ -32,16 +33,45 @@ struct ResponseInfo {
     std::vector<ChatMessage> messages;
     guint poll_interval;
     peel::String next_page_token;
+    // Set once the chat has ended; no more messages will arrive
+    peel::RefPtr<glib::DateTime> offline_at;
 };
 
-std::expected<peel::String, ErrorPtr> extract_video_id(const char* stream_url);
+/* What a stream URL points to. `id` is a slice of the URL itself */
+struct StreamUrlTarget {
+    enum class Kind {
+        Video,    // `id` is a video ID
+        Handle,   // `id` is a channel handle (without the '@'); its live stream has to be looked up
+        Channel   // `id` is a channel ID; its live stream has to be looked up
+    };
+    Kind kind;
+    std::string_view id;
+};
+
+// Understands youtube.com/watch?v=ID, youtu.be/ID, youtube.com/{live,shorts,embed}/ID,
+// youtube.com/@handle[/live] and youtube.com/channel/ID[/live]. Only allocates on failure
+std::expected<StreamUrlTarget, ErrorPtr> parse_stream_url(std::string_view stream_url);
 
 std::expected<StreamInfo, ErrorPtr> parse_stream_info(peel::ArrayRef<const char> response);
 
-std::expected<peel::String, ErrorPtr> parse_display_name(peel::ArrayRef<const char> response);
+// Returns the reason code (e.g. "liveChatEnded") of an API error response, or null if there isn't one
+peel::String parse_error_reason(peel::ArrayRef<const char> response);
+
+std::expected<ChannelIdentity, ErrorPtr> parse_channel_identity(peel::ArrayRef<const char> response);
+
+// The channel ID from a channels.list response (e.g. when looking up a handle)
+std::expected<peel::String, ErrorPtr> parse_channel_id(peel::ArrayRef<const char> response);
+
+// The video ID of the first result in a search.list response
+std::expected<peel::String, ErrorPtr> parse_search_video_id(peel::ArrayRef<const char> response);
 
 std::expected<ResponseInfo, ErrorPtr> parse_chat_messages(peel::ArrayRef<const char> response);
 
-peel::String create_text_message(const char* live_chat_id, const char* message);
+// Replaces the contents of `out` with the (compact) JSON request body for posting a text message
+void write_text_message(GString* out, const char* live_chat_id, const char* message);
+
+// Replaces the contents of `out` with the JSON request body for banning a user. A duration of 0
+// means a permanent ban
+void write_ban_request(GString* out, const char* live_chat_id, const char* channel_id, guint duration_seconds);
 
 } // namespace youtube
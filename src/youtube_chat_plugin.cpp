@@ -26,6 +26,7 @@ along with this program.  If not, see <https://www.gnu.org/licenses/>.
 #include "youtube_chat_connection.hpp"
 #include "youtube_chat_protocol.hpp"
 #include "youtube_error.h"
+#include "frame_pool.hpp"
 
 static peel::RefPtr<youtube::Protocol> youtube_chat_protocol;
 
@@ -97,6 +98,9 @@ gboolean youtube_chat_unload(GPluginPlugin*, gboolean, GError** error)
         }
     }
     youtube_chat_protocol = nullptr;
+    if(auto live_frame_count = frame_pool::get_live_frame_count()) {
+        g_warning("%zu coroutine frame(s) were never destroyed - some tasks were never resumed", live_frame_count);
+    }
     return true;
 }
 
@@ -56,6 +56,52 @@ peel::RefPtr<purple::AccountSettings> Protocol::vfunc_get_default_account_settin
     access_token_expiration->set_advanced(true);
     account_settings->add_setting(std::move(access_token_expiration));
 
+    auto message_history_depth = purple::AccountSettingString::create(
+        "message_history_depth", "Number of recent messages that can be deleted/retracted", "2000");
+    message_history_depth->set_advanced(true);
+    account_settings->add_setting(std::move(message_history_depth));
+
+    auto max_delivery_lag = purple::AccountSettingString::create(
+        "max_delivery_lag", "Seconds behind before ordinary chat messages are skipped", "10");
+    max_delivery_lag->set_advanced(true);
+    account_settings->add_setting(std::move(max_delivery_lag));
+
+    auto max_chat_members = purple::AccountSettingString::create(
+        "max_chat_members", "Max number of chatters shown in a chat's member list", "2000");
+    max_chat_members->set_advanced(true);
+    account_settings->add_setting(std::move(max_chat_members));
+
+    auto member_idle_timeout = purple::AccountSettingString::create(
+        "member_idle_timeout", "Minutes before inactive chatters are removed from the member list (0 = never)", "30");
+    member_idle_timeout->set_advanced(true);
+    account_settings->add_setting(std::move(member_idle_timeout));
+
+    auto delivery_latency_slo = purple::AccountSettingString::create(
+        "delivery_latency_slo", "Seconds of p95 chat delivery latency before a warning is raised (0 = never)", "10");
+    delivery_latency_slo->set_advanced(true);
+    account_settings->add_setting(std::move(delivery_latency_slo));
+
+    auto metrics_interval = purple::AccountSettingString::create(
+        "metrics_interval", "Seconds between connection metrics updates (0 = never)", "0");
+    metrics_interval->set_advanced(true);
+    account_settings->add_setting(std::move(metrics_interval));
+
+    auto network_thread = purple::AccountSettingString::create(
+        "network_thread", "Do network requests on a separate thread (true/false)", "false");
+    network_thread->set_advanced(true);
+    account_settings->add_setting(std::move(network_thread));
+
+    auto background_poll_multiplier = purple::AccountSettingString::create(
+        "background_poll_multiplier", "How many times less often chats in the background are checked", "4");
+    background_poll_multiplier->set_advanced(true);
+    account_settings->add_setting(std::move(background_poll_multiplier));
+
+    auto watch_upcoming = purple::AccountSettingString::create(
+        "watch_upcoming", "Join scheduled streams early and start reading chat once they go live (true/false)",
+        "true");
+    watch_upcoming->set_advanced(true);
+    account_settings->add_setting(std::move(watch_upcoming));
+
     return account_settings;
 }
 
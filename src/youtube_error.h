@@ -24,4 +24,16 @@ G_BEGIN_DECLS
 #define YOUTUBE_CHAT_ERROR youtube_chat_error_quark()
 GQuark youtube_chat_error_quark(void);
 
+typedef enum {
+    YOUTUBE_CHAT_ERROR_FAILED = 1,
+    /* An operation did not finish before its deadline */
+    YOUTUBE_CHAT_ERROR_TIMED_OUT,
+    /* The live chat has ended (or no longer exists) */
+    YOUTUBE_CHAT_ERROR_CHAT_ENDED,
+    /* The API rejected the request for being sent too soon after others */
+    YOUTUBE_CHAT_ERROR_RATE_LIMITED,
+    /* The account's credentials were rejected (e.g. the refresh token was revoked) */
+    YOUTUBE_CHAT_ERROR_UNAUTHORIZED
+} YoutubeChatError;
+
 G_END_DECLS
@@ -17,7 +17,12 @@ along with this program.  If not, see <https://www.gnu.org/licenses/>.
 */
 #pragma once
 
+#include <array>
+#include <cstddef>
+#include <string>
+#include <vector>
 #include "youtube_error.h"
+#include "latency_histogram.hpp"
 #include <peel/String.h>
 #include <peel/RefPtr.h>
 #include <peel/GLib/DateTime.h>
@@ -43,21 +48,148 @@ namespace purple = peel::Purple;
 
 namespace youtube {
 
+/* YouTube API endpoints that the client sends requests to */
+enum class Endpoint {
+    Channels,          // channels.list (user identity, handle lookups)
+    Videos,            // videos.list (stream info)
+    LiveChatMessages,  // liveChatMessages.list (polling)
+    SendMessage,       // liveChatMessages.insert
+    Moderation,        // liveChatBans.insert, liveChatMessages.delete
+    Search,            // search.list (a channel's current live stream)
+    Token              // OAuth token exchange/refresh
+};
+inline constexpr std::size_t ENDPOINT_COUNT = 7;
+
+/* How eagerly a conversation is polled */
+enum class ChatPriority {
+    Background,  // Polled at a multiple of the interval the API asks for
+    Normal,      // Polled at the interval the API asks for, backing off while the chat is silent
+    Foreground   // Always polled at the interval the API asks for
+};
+
+/* Counts of the work done to keep connections to the API warm (across all clients) */
+struct ConnectionWarmupStats {
+    // Connections opened ahead of the requests that will use them
+    guint64 preconnects = 0;
+    // Requests sent only to keep an otherwise idle connection open
+    guint64 keepalives = 0;
+};
+
+/* Kinds of failure, for counting errors */
+enum class ErrorClass {
+    Network,      // The request couldn't be sent or the response couldn't be read
+    Timeout,      // YOUTUBE_CHAT_ERROR_TIMED_OUT
+    RateLimited,  // YOUTUBE_CHAT_ERROR_RATE_LIMITED
+    ChatEnded,    // YOUTUBE_CHAT_ERROR_CHAT_ENDED
+    Api,          // Any other error response from the API
+    Parse         // The response couldn't be understood
+};
+inline constexpr std::size_t ERROR_CLASS_COUNT = 6;
+
+struct EndpointMetrics {
+    guint64 requests = 0;
+    // Requests that failed, for any reason other than being cancelled
+    guint64 failures = 0;
+    guint64 timeouts = 0;
+    guint64 bytes_sent = 0;
+    guint64 bytes_received = 0;
+    // Estimated YouTube API quota units spent on the endpoint
+    guint64 quota_units = 0;
+    LatencyHistogram::Snapshot latency;
+};
+
+struct ConversationMetrics {
+    std::string stream_url;
+    ChatPriority priority;
+    // Batches that subscribers haven't taken yet (summed across subscribers)
+    std::size_t buffered_batches = 0;
+    // Messages waiting to be posted
+    std::size_t queued_messages = 0;
+    // Polls in a row that returned no messages
+    guint idle_polls = 0;
+};
+
+/* Snapshot of a ChatClient's metrics. Counters only ever go up (from when the client was created),
+   so rates come from comparing two snapshots' counters and timestamps */
+struct ClientMetrics {
+    // g_get_monotonic_time() when the snapshot was taken
+    gint64 timestamp = 0;
+    // Indexed by Endpoint
+    std::array<EndpointMetrics, ENDPOINT_COUNT> endpoints;
+    // Indexed by ErrorClass
+    std::array<guint64, ERROR_CLASS_COUNT> errors{};
+    guint64 batches_received = 0;
+    guint64 messages_received = 0;
+    // Time spent parsing each poll response
+    LatencyHistogram::Snapshot parse_time;
+    // How long after being published each message was received, by the server's clock
+    LatencyHistogram::Snapshot receive_latency;
+    // Estimated difference between the API server's clock and the local clock, in microseconds
+    // (positive if the server is ahead). Estimated from the Date headers of API responses
+    gint64 clock_offset = 0;
+    guint64 token_refreshes = 0;
+    guint64 token_refresh_failures = 0;
+    // Shared by all clients
+    ConnectionWarmupStats warmup;
+    std::vector<ConversationMetrics> conversations;
+};
+
 struct StreamInfo {
     peel::String title;
+    // Null if the broadcast hasn't started yet
     peel::String live_chat_id;
+    // Null if the broadcast wasn't scheduled ahead of time
+    peel::RefPtr<glib::DateTime> scheduled_start_time;
+};
+
+/* The account's own YouTube channel */
+struct ChannelIdentity {
+    peel::String display_name;
+    peel::String channel_id;
+};
+
+/* Handle to one of a ChatClient's conversations. Once the conversation is disconnected, the handle
+   no longer refers to anything, even if another conversation is connected in its place */
+struct ConversationId {
+    guint32 index = 0;
+    // 0 for a handle that never referred to a conversation
+    guint32 generation = 0;
+
+    explicit operator bool() const noexcept { return generation != 0; }
+    bool operator==(const ConversationId&) const = default;
+};
+
+/* A moderator action to take in a chat */
+struct ModerationAction {
+    enum class Type {
+        Ban,           // Bans `target` (a channel ID) from the chat
+        Timeout,       // Bans `target` (a channel ID) for duration_seconds
+        DeleteMessage  // Deletes `target` (a message ID)
+    };
+    Type type;
+    std::string target;
+    guint duration_seconds = 0;
 };
 
 struct ChatMessage {
     enum class Type {
-        Text, Super, Ban
+        Text, Super, Ban, Deleted
     };
+    peel::String id;
+    // For Type::Deleted, the ID of the message that was deleted/retracted
+    peel::String target_id;
     peel::String channel_id;
     peel::String display_name;
     peel::RefPtr<glib::DateTime> timestamp;
     peel::String content;
     Type type;
     bool is_moderator;
+
+    // When the message was published (by the server's clock), in microseconds since the Unix epoch
+    gint64 get_published_at() const
+    {
+        return timestamp->to_unix() * G_USEC_PER_SEC + timestamp->get_microsecond();
+    }
 };
 
 } // namespace youtube